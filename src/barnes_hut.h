@@ -0,0 +1,306 @@
+#ifndef BARNES_HUT_H
+#define BARNES_HUT_H
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+#include "particle_store.h"
+#include "thread_pool.h"
+
+/*
+ * Barnes-Hut quadtree for the inverse-square attraction.
+ *
+ * Every particle has unit mass. A node far enough away (width / distance
+ * below the opening angle theta) is replaced by a single mass at its centre
+ * of mass, so each particle only visits O(log n) nodes instead of n - 1
+ * particles. Leaves hold a handful of particles that are summed directly.
+ */
+class BarnesHut{
+
+	public:
+		BarnesHut(float strength, float min_dist_sqr, float theta):
+			strength(strength),
+			min_dist_sqr(min_dist_sqr),
+			theta_sqr(theta * theta)
+		{}
+
+		void set_theta(float theta){
+			theta_sqr = theta * theta;
+		}
+
+		/*
+		 * Rebuild the tree around the current particle positions. With a
+		 * pool, the subtrees under the first few levels are built in
+		 * parallel and spliced back in depth-first order, which gives
+		 * exactly the tree a serial build does.
+		 */
+		void build(const ParticleStore &particles, ThreadPool *pool = nullptr){
+			const size_t count = particles.size();
+			ParticleStore::ConstColumn x = particles.x();
+			ParticleStore::ConstColumn y = particles.y();
+
+			nodes.clear();
+			order.resize(count);
+			px.resize(count);
+			py.resize(count);
+
+			if (count == 0){
+				return;
+			}
+
+			// Bounds of each range of particles, then of all of them
+			const size_t ranges = (count + BOUNDS_GRAIN - 1) / BOUNDS_GRAIN;
+			range_bounds.resize(ranges);
+			parallel_for(pool, 0, ranges, 1, [&](size_t first, size_t last){
+				for (size_t r = first; r < last; r++){
+					const size_t begin = r * BOUNDS_GRAIN;
+					const size_t end = std::min(count, begin + BOUNDS_GRAIN);
+					Bounds bounds{x[begin], x[begin], y[begin], y[begin]};
+					for (size_t i = begin; i < end; i++){
+						order[i] = static_cast<uint32_t>(i);
+						bounds.min_x = std::min(bounds.min_x, x[i]);
+						bounds.max_x = std::max(bounds.max_x, x[i]);
+						bounds.min_y = std::min(bounds.min_y, y[i]);
+						bounds.max_y = std::max(bounds.max_y, y[i]);
+					}
+					range_bounds[r] = bounds;
+				}
+			});
+
+			float min_x = range_bounds[0].min_x, max_x = range_bounds[0].max_x;
+			float min_y = range_bounds[0].min_y, max_y = range_bounds[0].max_y;
+			for (const Bounds &bounds : range_bounds){
+				min_x = std::min(min_x, bounds.min_x);
+				max_x = std::max(max_x, bounds.max_x);
+				min_y = std::min(min_y, bounds.min_y);
+				max_y = std::max(max_y, bounds.max_y);
+			}
+
+			// Square root cell, padded so nothing sits exactly on its edge
+			float half = 0.5f * std::max(max_x - min_x, max_y - min_y) * 1.001f + 1e-6f;
+			float centre_x = 0.5f * (min_x + max_x);
+			float centre_y = 0.5f * (min_y + max_y);
+
+			nodes.push_back(Node());
+			build_node(particles, nodes, 0, 0, static_cast<uint32_t>(count), centre_x, centre_y, half, 0, pool);
+		}
+
+		// Acceleration on particle i from every other particle
+		void acceleration(size_t i, const ParticleStore &particles, float &ax, float &ay) const{
+			const float x = particles.x()[i];
+			const float y = particles.y()[i];
+
+			float sum_x = 0.0f;
+			float sum_y = 0.0f;
+
+			uint32_t stack[STACK_SIZE];
+			int top = 0;
+			if (!nodes.empty()){
+				stack[top++] = 0;
+			}
+
+			while (top > 0){
+				const Node &node = nodes[stack[--top]];
+
+				float dist_x = node.com_x - x;
+				float dist_y = node.com_y - y;
+				float dist_sqr = (dist_x * dist_x) + (dist_y * dist_y);
+
+				// Gap between the query point and the node's box, zero inside it
+				float gap_x = std::max(std::fabs(x - node.centre_x) - node.half, 0.0f);
+				float gap_y = std::max(std::fabs(y - node.centre_y) - node.half, 0.0f);
+
+				/*
+				 * Far enough away: treat the node as one body. A box that
+				 * reaches within the minimum distance is always opened, as it
+				 * may hold pairs the leaf sum below leaves out, or i itself.
+				 */
+				if (node.child_count > 0 && node.width_sqr < theta_sqr * dist_sqr
+						&& (gap_x * gap_x) + (gap_y * gap_y) > min_dist_sqr){
+					float dist = std::sqrt(dist_sqr);
+					float force = strength * node.mass / dist_sqr;
+					sum_x += (dist_x / dist) * force;
+					sum_y += (dist_y / dist) * force;
+				} else if (node.child_count > 0){
+					for (uint32_t c = 0; c < node.child_count; c++){
+						stack[top++] = node.first_child + c;
+					}
+				} else{
+					// Leaf: sum its particles directly, skipping i itself
+					for (uint32_t k = node.begin; k < node.end; k++){
+						float leaf_dx = px[k] - x;
+						float leaf_dy = py[k] - y;
+						float leaf_dist_sqr = (leaf_dx * leaf_dx) + (leaf_dy * leaf_dy);
+						if (leaf_dist_sqr > min_dist_sqr){
+							float dist = std::sqrt(leaf_dist_sqr);
+							float force = strength / leaf_dist_sqr;
+							sum_x += (leaf_dx / dist) * force;
+							sum_y += (leaf_dy / dist) * force;
+						}
+					}
+				}
+			}
+
+			ax = sum_x;
+			ay = sum_y;
+		}
+
+	private:
+
+		struct Node{
+			float com_x = 0.0f, com_y = 0.0f;
+			float mass = 0.0f;
+			float width_sqr = 0.0f;
+			float centre_x = 0.0f, centre_y = 0.0f;
+			float half = 0.0f;
+			uint32_t begin = 0, end = 0;
+			uint32_t first_child = 0;
+			uint32_t child_count = 0;
+		};
+
+		struct Bounds{
+			float min_x, max_x;
+			float min_y, max_y;
+		};
+
+		/*
+		 * Splits order[begin, end) into the four quadrants around the node
+		 * centre. Children of a node are stored next to each other so a node
+		 * only needs the index of the first one.
+		 */
+		void build_node(const ParticleStore &particles, std::vector<Node> &nodes, uint32_t index,
+				uint32_t begin, uint32_t end,
+				float centre_x, float centre_y, float half, int depth, ThreadPool *pool){
+
+			nodes[index].begin = begin;
+			nodes[index].end = end;
+			nodes[index].width_sqr = 4.0f * half * half;
+			nodes[index].centre_x = centre_x;
+			nodes[index].centre_y = centre_y;
+			nodes[index].half = half;
+
+			if (end - begin <= LEAF_SIZE || depth >= MAX_DEPTH){
+				float com_x = 0.0f, com_y = 0.0f;
+				for (uint32_t k = begin; k < end; k++){
+					px[k] = particles.x()[order[k]];
+					py[k] = particles.y()[order[k]];
+					com_x += px[k];
+					com_y += py[k];
+				}
+				float mass = static_cast<float>(end - begin);
+				nodes[index].mass = mass;
+				nodes[index].com_x = com_x / mass;
+				nodes[index].com_y = com_y / mass;
+				return;
+			}
+
+			// Partition on y, then each half on x: bottom-left, bottom-right, top-left, top-right
+			ParticleStore::ConstColumn x = particles.x();
+			ParticleStore::ConstColumn y = particles.y();
+			auto below = [&](uint32_t p){ return y[p] < centre_y; };
+			auto left = [&](uint32_t p){ return x[p] < centre_x; };
+
+			uint32_t *base = order.data();
+			uint32_t mid_y = static_cast<uint32_t>(std::partition(base + begin, base + end, below) - base);
+			uint32_t mid_bottom = static_cast<uint32_t>(std::partition(base + begin, base + mid_y, left) - base);
+			uint32_t mid_top = static_cast<uint32_t>(std::partition(base + mid_y, base + end, left) - base);
+
+			const uint32_t bounds[5] = {begin, mid_bottom, mid_y, mid_top, end};
+			const float quarter = 0.5f * half;
+			const float offsets[4][2] = {{-quarter, -quarter}, {quarter, -quarter}, {-quarter, quarter}, {quarter, quarter}};
+
+			uint32_t child_count = 0;
+			for (int q = 0; q < 4; q++){
+				if (bounds[q + 1] > bounds[q]){
+					child_count++;
+				}
+			}
+
+			uint32_t first_child = static_cast<uint32_t>(nodes.size());
+			nodes.resize(nodes.size() + child_count);
+			nodes[index].first_child = first_child;
+			nodes[index].child_count = child_count;
+
+			if (pool && depth < PARALLEL_DEPTH && end - begin >= PARALLEL_MIN_PARTICLES){
+				/*
+				 * Each quadrant grows its own node list with its root at 0,
+				 * then the lists are appended in quadrant order and their
+				 * child indices shifted to where they landed.
+				 */
+				std::vector<Node> subtrees[4];
+				pool->parallel_for(0, 4, 1, [&](size_t q_begin, size_t q_end){
+					for (size_t q = q_begin; q < q_end; q++){
+						if (bounds[q + 1] == bounds[q]){
+							continue;
+						}
+						subtrees[q].push_back(Node());
+						build_node(particles, subtrees[q], 0, bounds[q], bounds[q + 1],
+								centre_x + offsets[q][0], centre_y + offsets[q][1], quarter, depth + 1, pool);
+					}
+				});
+
+				uint32_t child = first_child;
+				for (int q = 0; q < 4; q++){
+					if (subtrees[q].empty()){
+						continue;
+					}
+					const uint32_t shift = static_cast<uint32_t>(nodes.size()) - 1;
+					for (Node &node : subtrees[q]){
+						if (node.child_count > 0){
+							node.first_child += shift;
+						}
+					}
+					nodes[child++] = subtrees[q][0];
+					nodes.insert(nodes.end(), subtrees[q].begin() + 1, subtrees[q].end());
+				}
+			} else{
+				uint32_t child = first_child;
+				for (int q = 0; q < 4; q++){
+					if (bounds[q + 1] == bounds[q]){
+						continue;
+					}
+					build_node(particles, nodes, child, bounds[q], bounds[q + 1],
+							centre_x + offsets[q][0], centre_y + offsets[q][1], quarter, depth + 1, nullptr);
+					child++;
+				}
+			}
+
+			float com_x = 0.0f, com_y = 0.0f;
+			for (uint32_t child = first_child; child < first_child + child_count; child++){
+				com_x += nodes[child].com_x * nodes[child].mass;
+				com_y += nodes[child].com_y * nodes[child].mass;
+			}
+
+			float mass = static_cast<float>(end - begin);
+			nodes[index].mass = mass;
+			nodes[index].com_x = com_x / mass;
+			nodes[index].com_y = com_y / mass;
+		}
+
+		static const uint32_t LEAF_SIZE = 8;
+		static const int MAX_DEPTH = 32;
+		static const int STACK_SIZE = 4 * MAX_DEPTH + 4;
+
+		// Levels whose quadrants are built as separate tasks, and the smallest node worth splitting
+		static const int PARALLEL_DEPTH = 3;
+		static const uint32_t PARALLEL_MIN_PARTICLES = 4096;
+
+		// Particles per task when finding the bounds
+		static const size_t BOUNDS_GRAIN = 4096;
+
+		float strength;
+		float min_dist_sqr;
+		float theta_sqr;
+
+		std::vector<Node> nodes;
+		std::vector<Bounds> range_bounds;
+
+		// Particle indices in tree order and their positions, leaf by leaf
+		std::vector<uint32_t> order;
+		std::vector<float> px;
+		std::vector<float> py;
+};
+
+#endif
@@ -0,0 +1,336 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include "simulation.h"
+#include "command_line.h"
+#include "measure.h"
+#include "hardware_info.h"
+
+/*
+ * Times each phase of Simulation::update_particles on its own, over a range
+ * of particle counts, so a change to the engine can be judged by numbers
+ * rather than by feel.
+ *
+ * For every count the simulation is warmed up first, then run for a number
+ * of repetitions that each last at least --min-time seconds. Each phase is
+ * reported as ns per particle per tick: the median repetition, the fastest
+ * and slowest, and the relative standard deviation across repetitions.
+ * Pair interactions/s counts all n (n - 1) / 2 pairs per tick, as
+ * dretsim_headless does.
+ *
+ * Frequency scaling makes timings drift, so the CPU is spun up before the
+ * first count, the cpufreq governor and clock are read from sysfs, and
+ * counts over which the clock moved are flagged.
+ *
+ * With --json the results are also written as JSON, to a file or to
+ * stdout with "-", to track over time.
+ */
+
+const double FIXED_DT = 1.0f / 60.0f;
+
+// Busy time before the first count, for the clock to ramp up
+const double SPIN_UP_SECONDS = 0.5;
+
+// Clock change over one count above which its timings are flagged
+const double FREQUENCY_TOLERANCE = 0.05;
+
+struct BenchOptions{
+	std::vector<long> sizes = {500, 1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000};
+	SampleSettings sampling;
+
+	// The direct sum at a million particles takes minutes a tick
+	long direct_limit = 50000;
+
+	std::string json;
+	const ScenarioInfo *scenario = find_scenario("uniform");
+	SimulationSettings settings;
+};
+
+struct SizeResult{
+	long count = 0;
+	long ticks = 0;
+	Spread reorder;
+	Spread long_range;
+	Spread short_range;
+	Spread step;
+	Spread total;
+	Spread pairs_per_second;
+	CpuFrequency before;
+	CpuFrequency after;
+	bool frequency_drift = false;
+
+	// Hardware counts over the timed repetitions, and the particle ticks they cover
+	bool counted = false;
+	PhaseCounterTotals counters;
+	double particle_ticks = 0.0;
+};
+
+void print_usage(const char *program){
+	std::cout << "Usage: " << program << " [options]\n"
+		<< "  --sizes LIST        comma-separated particle counts (default 500 up to 1000000)\n"
+		<< "  --solver NAME       direct, barnes-hut, fmm or mesh (default barnes-hut)\n"
+		<< "  --reps N            timed repetitions per count (default 5)\n"
+		<< "  --warmup N          untimed ticks per count (default 2)\n"
+		<< "  --min-time S        least seconds per repetition (default 0.2)\n"
+		<< "  --direct-limit N    largest count the direct solver runs (default 50000)\n"
+		<< "  --reorder N         reorder interval in ticks, 0 for none (default 0)\n"
+		<< "  --threads N         worker threads, 0 for one per hardware thread (default 0)\n"
+		<< "  --seed N            seed, not 0, so runs repeat (default 1)\n"
+		<< "  --json FILE         also write the results as JSON, - for stdout\n"
+		<< "  --counters          IPC and misses per particle for each phase (DRETSIM_PERF_COUNTERS builds)\n"
+		<< "  --scenario NAME     starting state (default uniform), one of:\n";
+	print_scenarios(std::cout);
+}
+
+// Fills options from argv; prints what is wrong and returns false on bad input
+bool parse_options(int argc, char **argv, BenchOptions &options){
+	for (int a = 1; a < argc; a++){
+		std::string flag = argv[a];
+		if (flag == "--help" || flag == "-h"){
+			print_usage(argv[0]);
+			std::exit(0);
+		}
+		if (flag == "--counters"){
+			options.settings.perf_counters = true;
+			continue;
+		}
+		if (a + 1 >= argc){
+			std::cerr << "Missing value for " << flag << "\n";
+			return false;
+		}
+		const char *value = argv[++a];
+
+		long number = 0;
+		bool ok = true;
+		if (flag == "--sizes"){
+			ok = parse_list(value, 2, options.sizes, INT_MAX);
+		} else if (flag == "--solver"){
+			ok = parse_solver(value, options.settings.solver);
+		} else if (flag == "--reps"){
+			ok = parse_number(value, 1, number);
+			options.sampling.reps = number;
+		} else if (flag == "--warmup"){
+			ok = parse_number(value, 0, number);
+			options.sampling.warmup = number;
+		} else if (flag == "--min-time"){
+			char *end = nullptr;
+			options.sampling.min_time = std::strtod(value, &end);
+			ok = end != value && *end == '\0' && options.sampling.min_time >= 0.0;
+		} else if (flag == "--direct-limit"){
+			ok = parse_number(value, 2, number);
+			options.direct_limit = number;
+		} else if (flag == "--reorder"){
+			ok = parse_number(value, 0, number, INT_MAX);
+			options.settings.reorder_interval = static_cast<int>(number);
+		} else if (flag == "--threads"){
+			ok = parse_number(value, 0, number, INT_MAX);
+			options.settings.threads = static_cast<int>(number);
+		} else if (flag == "--seed"){
+			ok = parse_seed(value, options.settings.seed) && options.settings.seed != 0;
+		} else if (flag == "--json"){
+			options.json = value;
+		} else if (flag == "--scenario"){
+			options.scenario = find_scenario(value);
+			ok = options.scenario != nullptr;
+		} else{
+			std::cerr << "Unknown option " << flag << "\n";
+			return false;
+		}
+
+		if (!ok){
+			std::cerr << "Bad value for " << flag << ": " << value << "\n";
+			return false;
+		}
+	}
+	return true;
+}
+
+SizeResult run_size(const BenchOptions &options, long count){
+	SizeResult result;
+	result.count = count;
+	result.before = read_cpu_frequency();
+
+	// Building an evolved state runs the simulation, so it stays outside the timings
+	Simulation sim(build_scenario(*options.scenario, static_cast<int>(count), options.settings.seed, options.settings.threads),
+			options.settings);
+
+	PhaseSamples samples = sample_phases(sim, FIXED_DT, options.sampling);
+	result.ticks = samples.ticks;
+
+	// Per tick to per particle per tick, in nanoseconds
+	const double per_particle = 1e6 / double(count);
+	result.reorder = spread_of(scaled(samples.reorder, per_particle));
+	result.long_range = spread_of(scaled(samples.long_range, per_particle));
+	result.short_range = spread_of(scaled(samples.short_range, per_particle));
+	result.step = spread_of(scaled(samples.step, per_particle));
+	result.total = spread_of(scaled(samples.total, per_particle));
+
+	const double pairs = 0.5 * double(count) * double(count - 1);
+	std::vector<double> pairs_per_second;
+	for (double ms : samples.total){
+		pairs_per_second.push_back(pairs * 1e3 / ms);
+	}
+	result.pairs_per_second = spread_of(pairs_per_second);
+
+	result.counted = sim.get_perf_counters().is_open();
+	result.counters = samples.counters;
+	result.particle_ticks = double(count) * samples.ticks * options.sampling.reps;
+
+	result.after = read_cpu_frequency();
+	if (result.before.mhz > 0.0){
+		result.frequency_drift = std::fabs(result.after.mhz - result.before.mhz) > FREQUENCY_TOLERANCE * result.before.mhz;
+	}
+	return result;
+}
+
+void print_phase(std::ostream &out, const char *name, const Spread &spread){
+	out << "  " << name << std::string(14 - std::string(name).size(), ' ')
+		<< spread.median << " ns/particle  [" << spread.min << ", " << spread.max << "]  rsd "
+		<< spread.rsd * 100.0 << "%\n";
+}
+
+void print_counters(std::ostream &out, const char *name, const PhaseCounters &counters, double particle_ticks){
+	out << "  " << name << std::string(14 - std::string(name).size(), ' ')
+		<< "ipc " << counters.ipc()
+		<< ", per particle: L1d misses " << counters.l1d_misses / particle_ticks
+		<< ", LLC misses " << counters.llc_misses / particle_ticks
+		<< ", branch misses " << counters.branch_misses / particle_ticks << "\n";
+}
+
+void print_result(std::ostream &out, const SizeResult &result){
+	out << "n " << result.count << ", " << result.ticks << " ticks per repetition\n";
+	print_phase(out, "reorder", result.reorder);
+	print_phase(out, "long range", result.long_range);
+	print_phase(out, "short range", result.short_range);
+	print_phase(out, "step", result.step);
+	print_phase(out, "total", result.total);
+	out << "  pair interactions/s " << result.pairs_per_second.median << "\n";
+	if (result.counted){
+		print_counters(out, "reorder", result.counters.reorder, result.particle_ticks);
+		print_counters(out, "long range", result.counters.long_range, result.particle_ticks);
+		print_counters(out, "short range", result.counters.short_range, result.particle_ticks);
+		print_counters(out, "step", result.counters.step, result.particle_ticks);
+	}
+	if (result.frequency_drift){
+		out << "  warning: clock moved from " << result.before.mhz << " to " << result.after.mhz
+			<< " MHz during this count\n";
+	}
+}
+
+void write_spread(std::ostream &out, const char *name, const Spread &spread){
+	out << "\"" << name << "\": {\"min\": " << spread.min << ", \"median\": " << spread.median
+		<< ", \"max\": " << spread.max << ", \"rsd\": " << spread.rsd << "}";
+}
+
+void write_counters(std::ostream &out, const char *name, const PhaseCounters &counters, double particle_ticks){
+	out << "\"" << name << "\": {\"ipc\": " << counters.ipc()
+		<< ", \"l1d_misses_per_particle\": " << counters.l1d_misses / particle_ticks
+		<< ", \"llc_misses_per_particle\": " << counters.llc_misses / particle_ticks
+		<< ", \"branch_misses_per_particle\": " << counters.branch_misses / particle_ticks << "}";
+}
+
+void write_json(std::ostream &out, const BenchOptions &options, const Simulation &sim, const std::vector<SizeResult> &results){
+	out.precision(6);
+	out << "{\n"
+		<< "  \"scenario\": \"" << options.scenario->name << "\",\n"
+		<< "  \"solver\": \"" << solver_name(options.settings.solver) << "\",\n"
+		<< "  \"threads\": " << sim.get_thread_count() << ",\n"
+		<< "  \"simd\": \"" << simd_level_name(sim.get_simd_level()) << "\",\n"
+		<< "  \"block_width\": " << ParticleStore::BLOCK_WIDTH << ",\n"
+		<< "  \"seed\": " << sim.get_seed() << ",\n"
+		<< "  \"reorder_interval\": " << options.settings.reorder_interval << ",\n"
+		<< "  \"reps\": " << options.sampling.reps << ",\n"
+		<< "  \"results\": [";
+	for (size_t k = 0; k < results.size(); k++){
+		const SizeResult &result = results[k];
+		out << (k ? "," : "") << "\n    {\"n\": " << result.count << ", \"ticks_per_rep\": " << result.ticks
+			<< ",\n     \"ns_per_particle\": {";
+		write_spread(out, "reorder", result.reorder);
+		out << ", ";
+		write_spread(out, "long_range", result.long_range);
+		out << ",\n       ";
+		write_spread(out, "short_range", result.short_range);
+		out << ", ";
+		write_spread(out, "step", result.step);
+		out << ",\n       ";
+		write_spread(out, "total", result.total);
+		out << "},\n     ";
+		write_spread(out, "pair_interactions_per_s", result.pairs_per_second);
+		if (result.counted){
+			out << ",\n     \"counters\": {";
+			write_counters(out, "reorder", result.counters.reorder, result.particle_ticks);
+			out << ",\n       ";
+			write_counters(out, "long_range", result.counters.long_range, result.particle_ticks);
+			out << ",\n       ";
+			write_counters(out, "short_range", result.counters.short_range, result.particle_ticks);
+			out << ",\n       ";
+			write_counters(out, "step", result.counters.step, result.particle_ticks);
+			out << "}";
+		}
+		out << ",\n     \"cpu\": {\"governor\": \"" << result.before.governor << "\", \"mhz_before\": "
+			<< result.before.mhz << ", \"mhz_after\": " << result.after.mhz << ", \"frequency_drift\": "
+			<< (result.frequency_drift ? "true" : "false") << "}}";
+	}
+	out << "\n  ]\n}\n";
+}
+
+int main(int argc, char **argv){
+	BenchOptions options;
+	options.settings.solver = Solver::BarnesHut;
+	options.settings.seed = 1;
+	if (!parse_options(argc, argv, options)){
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	// JSON on stdout pushes the readable report to stderr
+	std::ostream &report = options.json == "-" ? std::cerr : std::cout;
+
+	// Only used for the run-wide details: threads, SIMD level and seed
+	Simulation probe(2, options.settings);
+	report << "scenario " << options.scenario->name
+		<< ", solver " << solver_name(options.settings.solver)
+		<< ", threads " << probe.get_thread_count()
+		<< ", simd " << simd_level_name(probe.get_simd_level())
+		<< ", seed " << probe.get_seed() << "\n";
+
+	if (options.settings.perf_counters && !probe.get_perf_counters().is_open()){
+		report << "warning: no hardware counters: " << probe.get_perf_counters().error() << "\n";
+	}
+
+	CpuFrequency frequency = read_cpu_frequency();
+	if (frequency.governor == "unknown"){
+		report << "warning: no cpufreq in sysfs, the clock cannot be checked\n";
+	} else if (frequency.governor != "performance"){
+		report << "warning: cpufreq governor is " << frequency.governor
+			<< ", not performance; timings may drift with the clock\n";
+	}
+	spin_up(SPIN_UP_SECONDS);
+
+	std::vector<SizeResult> results;
+	for (long count : options.sizes){
+		if (options.settings.solver == Solver::Direct && count > options.direct_limit){
+			report << "n " << count << " skipped: above --direct-limit for the direct solver\n";
+			continue;
+		}
+		results.push_back(run_size(options, count));
+		print_result(report, results.back());
+	}
+
+	if (options.json == "-"){
+		write_json(std::cout, options, probe, results);
+	} else if (!options.json.empty()){
+		std::ofstream file(options.json);
+		if (!file){
+			std::cerr << "Cannot write " << options.json << "\n";
+			return 1;
+		}
+		write_json(file, options, probe, results);
+	}
+	return 0;
+}
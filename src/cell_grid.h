@@ -0,0 +1,134 @@
+#ifndef CELL_GRID_H
+#define CELL_GRID_H
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include "particle_store.h"
+#include "thread_pool.h"
+
+/*
+ * Uniform grid over the [-1, 1] box used for short-range neighbour searches.
+ *
+ * Cells are at least `cutoff` wide, so any two particles closer than the
+ * cutoff sit in the same cell or in one of the 8 cells around it. The grid
+ * is rebuilt from scratch every tick with a counting sort: after build(),
+ * the particles of cell c are sorted[cell_start[c]] .. sorted[cell_start[c + 1]].
+ *
+ * The sort counts and scatters fixed chunks of the particles separately,
+ * in parallel when given a pool. Within a cell each chunk's particles
+ * follow the earlier chunks', so every cell lists its particles in index
+ * order, as a serial sort would.
+ */
+class CellGrid{
+
+	public:
+		CellGrid(float cutoff){
+			side = static_cast<int>(2.0f / cutoff);
+			if (side < 1){
+				side = 1;
+			}
+			inv_cell_size = side / 2.0f;
+			cell_start.resize(side * side + 1);
+		}
+
+		void build(const ParticleStore &particles, ThreadPool *pool = nullptr){
+			const size_t count = particles.size();
+			const size_t cells = cell_start.size() - 1;
+			ParticleStore::ConstColumn x = particles.x();
+			ParticleStore::ConstColumn y = particles.y();
+
+			const size_t chunks = std::min(size_t(MAX_CHUNKS), std::max<size_t>(1, count / CHUNK_PARTICLES));
+			const size_t chunk_size = (count + chunks - 1) / chunks;
+			particle_cell.resize(count);
+			sorted.resize(count);
+			cursor.assign(chunks * cells, 0);
+
+			// Count particles per cell, each chunk into its own row of counters
+			parallel_for(pool, 0, chunks, 1, [&](size_t first, size_t last){
+				for (size_t chunk = first; chunk < last; chunk++){
+					uint32_t *counts = cursor.data() + chunk * cells;
+					const size_t end = std::min(count, (chunk + 1) * chunk_size);
+					for (size_t i = std::min(count, chunk * chunk_size); i < end; i++){
+						uint32_t c = cell_of(x[i], y[i]);
+						particle_cell[i] = c;
+						counts[c]++;
+					}
+				}
+			});
+
+			// Exclusive prefix sum, cell-major, so chunk order is kept within a cell
+			uint32_t sum = 0;
+			for (size_t c = 0; c < cells; c++){
+				cell_start[c] = sum;
+				for (size_t chunk = 0; chunk < chunks; chunk++){
+					uint32_t n = cursor[chunk * cells + c];
+					cursor[chunk * cells + c] = sum;
+					sum += n;
+				}
+			}
+			cell_start[cells] = sum;
+
+			// Scatter indices into their cell's slot range
+			parallel_for(pool, 0, chunks, 1, [&](size_t first, size_t last){
+				for (size_t chunk = first; chunk < last; chunk++){
+					uint32_t *slots = cursor.data() + chunk * cells;
+					const size_t end = std::min(count, (chunk + 1) * chunk_size);
+					for (size_t i = std::min(count, chunk * chunk_size); i < end; i++){
+						sorted[slots[particle_cell[i]]++] = static_cast<uint32_t>(i);
+					}
+				}
+			});
+		}
+
+		int cells_per_side() const{
+			return side;
+		}
+
+		uint32_t cell_begin(int c) const{
+			return cell_start[c];
+		}
+
+		uint32_t cell_end(int c) const{
+			return cell_start[c + 1];
+		}
+
+		// Particle indices grouped by cell
+		const std::vector<uint32_t> &sorted_indices() const{
+			return sorted;
+		}
+
+		/*
+		 * Particles may sit slightly outside the box until the wall bounce
+		 * catches them, so coordinates are clamped onto the edge cells.
+		 * Clamping never pulls two particles further apart in cell space,
+		 * which keeps the 3x3 neighbourhood guarantee intact.
+		 */
+		int cell_coord(float v) const{
+			int c = static_cast<int>((v + 1.0f) * inv_cell_size);
+			return std::min(std::max(c, 0), side - 1);
+		}
+
+		uint32_t cell_of(float x, float y) const{
+			return cell_coord(y) * side + cell_coord(x);
+		}
+
+	private:
+
+		// Particles per chunk, and the most chunks a build is cut into
+		static const size_t CHUNK_PARTICLES = 4096;
+		static const size_t MAX_CHUNKS = 64;
+
+		int side;
+		float inv_cell_size;
+
+		std::vector<uint32_t> cell_start;
+
+		// Per-chunk cell counts, then each chunk's next free slot per cell
+		std::vector<uint32_t> cursor;
+		std::vector<uint32_t> particle_cell;
+		std::vector<uint32_t> sorted;
+};
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef COMMAND_LINE_H
+#define COMMAND_LINE_H
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <cstdlib>
+#include <cstdint>
+#include <cerrno>
+#include <cctype>
+#include <climits>
+#include <iostream>
+
+#include "simulation_settings.h"
+#include "scenarios.h"
+
+// Helpers shared by the command-line programs
+
+inline bool parse_solver(const std::string &name, Solver &solver){
+	if (name == "direct"){
+		solver = Solver::Direct;
+	} else if (name == "barnes-hut"){
+		solver = Solver::BarnesHut;
+	} else if (name == "fmm"){
+		solver = Solver::FastMultipole;
+	} else if (name == "mesh"){
+		solver = Solver::ParticleMesh;
+	} else{
+		return false;
+	}
+	return true;
+}
+
+inline const char *solver_name(Solver solver){
+	switch (solver){
+		case Solver::Direct:
+			return "direct";
+		case Solver::BarnesHut:
+			return "barnes-hut";
+		case Solver::FastMultipole:
+			return "fmm";
+		case Solver::ParticleMesh:
+			return "mesh";
+	}
+	return "unknown";
+}
+
+// Reads a whole-number argument, rejecting trailing junk and values outside minimum .. maximum
+inline bool parse_number(const char *text, long minimum, long &value, long maximum = LONG_MAX){
+	char *end = nullptr;
+	errno = 0;
+	long parsed = std::strtol(text, &end, 10);
+	if (end == text || *end != '\0' || errno == ERANGE || parsed < minimum || parsed > maximum){
+		return false;
+	}
+	value = parsed;
+	return true;
+}
+
+// Comma-separated whole numbers, none outside minimum .. maximum
+inline bool parse_list(const std::string &text, long minimum, std::vector<long> &values, long maximum = LONG_MAX){
+	values.clear();
+	std::stringstream stream(text);
+	std::string item;
+	while (std::getline(stream, item, ',')){
+		long value = 0;
+		if (!parse_number(item.c_str(), minimum, value, maximum)){
+			return false;
+		}
+		values.push_back(value);
+	}
+	return !values.empty();
+}
+
+// Digits only: strtoull alone would read "-1" as the largest seed
+inline bool parse_seed(const char *text, uint64_t &seed){
+	if (!std::isdigit(static_cast<unsigned char>(text[0]))){
+		return false;
+	}
+	char *end = nullptr;
+	errno = 0;
+	unsigned long long parsed = std::strtoull(text, &end, 10);
+	if (*end != '\0' || errno == ERANGE){
+		return false;
+	}
+	seed = parsed;
+	return true;
+}
+
+// One line per catalog entry, for usage messages
+inline void print_scenarios(std::ostream &out){
+	for (const ScenarioInfo &info : scenario_catalog()){
+		out << "    " << info.name << std::string(18 - std::string(info.name).size(), ' ') << info.description << "\n";
+	}
+}
+
+#endif
@@ -0,0 +1,162 @@
+#ifndef CURVE_SORTER_H
+#define CURVE_SORTER_H
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <utility>
+
+#include "particle_store.h"
+#include "thread_pool.h"
+
+enum class Curve{
+	Morton,		// Z-order, cheapest key
+	Hilbert		// no long jumps between neighbouring keys
+};
+
+/*
+ * Orders particles along a space-filling curve so that particles close in
+ * space end up close in memory.
+ *
+ * Positions are quantised to 16 bits per axis over the [-1, 1] box and
+ * turned into a 32-bit curve key, then sorted with an LSD radix sort, 8 bits
+ * per pass. Each pass histograms fixed chunks of the input separately, turns
+ * the histograms into output offsets with one serial prefix sum, and then
+ * scatters every chunk into its own slices of the output. With a pool the
+ * chunks are histogrammed and scattered in parallel. The chunks do not
+ * depend on the thread count and the sort is stable, so the order is the
+ * same however many threads run it.
+ */
+class CurveSorter{
+
+	public:
+		// Fills order with particle indices sorted along the curve
+		void sort(const ParticleStore &particles, Curve curve, std::vector<uint32_t> &order, ThreadPool *pool = nullptr){
+			const size_t count = particles.size();
+			ParticleStore::ConstColumn x = particles.x();
+			ParticleStore::ConstColumn y = particles.y();
+
+			keys.resize(count);
+			order.resize(count);
+			parallel_for(pool, 0, count, KEY_GRAIN, [&](size_t first, size_t last){
+				for (size_t i = first; i < last; i++){
+					uint32_t qx = quantise(x[i]);
+					uint32_t qy = quantise(y[i]);
+					keys[i] = curve == Curve::Morton ? morton_key(qx, qy) : hilbert_key(qx, qy);
+					order[i] = static_cast<uint32_t>(i);
+				}
+			});
+
+			radix_sort(order, pool);
+		}
+
+		static uint32_t morton_key(uint32_t x, uint32_t y){
+			return spread_bits(x) | (spread_bits(y) << 1);
+		}
+
+		// Distance along a Hilbert curve filling the 2^16 x 2^16 grid
+		static uint32_t hilbert_key(uint32_t x, uint32_t y){
+			const uint32_t n = 1u << BITS;
+			uint32_t d = 0;
+
+			for (uint32_t s = n / 2; s > 0; s /= 2){
+				uint32_t rx = (x & s) > 0;
+				uint32_t ry = (y & s) > 0;
+				d += s * s * ((3 * rx) ^ ry);
+
+				// Rotate the quadrant so the sub-curve has the standard orientation
+				if (ry == 0){
+					if (rx == 1){
+						x = n - 1 - x;
+						y = n - 1 - y;
+					}
+					std::swap(x, y);
+				}
+			}
+
+			return d;
+		}
+
+	private:
+
+		static uint32_t quantise(float v){
+			float t = (v + 1.0f) * 0.5f * static_cast<float>((1u << BITS) - 1);
+			t = std::min(std::max(t, 0.0f), static_cast<float>((1u << BITS) - 1));
+			return static_cast<uint32_t>(t);
+		}
+
+		// Spread the low 16 bits of v out to the even bit positions
+		static uint32_t spread_bits(uint32_t v){
+			v &= 0x0000ffff;
+			v = (v | (v << 8)) & 0x00ff00ff;
+			v = (v | (v << 4)) & 0x0f0f0f0f;
+			v = (v | (v << 2)) & 0x33333333;
+			v = (v | (v << 1)) & 0x55555555;
+			return v;
+		}
+
+		/*
+		 * Each chunk's histogram is a row of its own, so chunks counting in
+		 * parallel only ever write to their own row.
+		 */
+		void radix_sort(std::vector<uint32_t> &order, ThreadPool *pool){
+			const size_t count = keys.size();
+			const size_t chunk_size = (count + CHUNKS - 1) / CHUNKS;
+
+			keys_swap.resize(count);
+			order_swap.resize(count);
+			histogram.resize(CHUNKS * RADIX);
+
+			for (int shift = 0; shift < 32; shift += 8){
+				parallel_for(pool, 0, CHUNKS, 1, [&](size_t first, size_t last){
+					for (size_t chunk = first; chunk < last; chunk++){
+						size_t *row = histogram.data() + chunk * RADIX;
+						std::fill(row, row + RADIX, 0);
+						size_t begin = std::min(chunk * chunk_size, count);
+						size_t end = std::min(begin + chunk_size, count);
+						for (size_t i = begin; i < end; i++){
+							row[(keys[i] >> shift) & 0xff]++;
+						}
+					}
+				});
+
+				// Exclusive prefix sum, digit-major, so chunk order is kept within a digit
+				size_t sum = 0;
+				for (size_t digit = 0; digit < RADIX; digit++){
+					for (size_t chunk = 0; chunk < CHUNKS; chunk++){
+						size_t c = histogram[chunk * RADIX + digit];
+						histogram[chunk * RADIX + digit] = sum;
+						sum += c;
+					}
+				}
+
+				parallel_for(pool, 0, CHUNKS, 1, [&](size_t first, size_t last){
+					for (size_t chunk = first; chunk < last; chunk++){
+						size_t *row = histogram.data() + chunk * RADIX;
+						size_t begin = std::min(chunk * chunk_size, count);
+						size_t end = std::min(begin + chunk_size, count);
+						for (size_t i = begin; i < end; i++){
+							size_t slot = row[(keys[i] >> shift) & 0xff]++;
+							keys_swap[slot] = keys[i];
+							order_swap[slot] = order[i];
+						}
+					}
+				});
+
+				keys.swap(keys_swap);
+				order.swap(order_swap);
+			}
+		}
+
+		static const uint32_t BITS = 16;
+		static const size_t RADIX = 256;
+		static const size_t CHUNKS = 16;
+		static const size_t KEY_GRAIN = 4096;
+
+		std::vector<uint32_t> keys;
+		std::vector<uint32_t> keys_swap;
+		std::vector<uint32_t> order_swap;
+		std::vector<size_t> histogram;
+};
+
+#endif
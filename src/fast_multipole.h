@@ -0,0 +1,616 @@
+#ifndef FAST_MULTIPOLE_H
+#define FAST_MULTIPOLE_H
+
+#include <vector>
+#include <complex>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+#include "particle_store.h"
+#include "thread_pool.h"
+
+/*
+ * 2D Fast Multipole Method for the inverse-square attraction.
+ *
+ * The force strength / d^2 comes from the potential 1 / |z - w| with
+ * positions written as complex numbers. That potential is not harmonic in
+ * the plane, so instead of a Laurent series in z alone it is expanded in
+ * both z and its conjugate:
+ *
+ *   1 / |Z - W| = |Z|^-1 (1 - W / Z)^-1/2 (1 - conj(W) / conj(Z))^-1/2
+ *               = |Z|^-1 sum a_m a_n W^m conj(W)^n Z^-m conj(Z)^-n
+ *
+ * with a_m the coefficients of (1 - t)^-1/2. A cell's multipole moments are
+ * M_mn = sum W^m conj(W)^n over its particles, and local expansions are
+ * polynomials in u and conj(u). Both are truncated at m + n <= order, so
+ * the error falls off geometrically with the expansion order.
+ *
+ * The tree is a uniform quadtree over the particles' bounding square.
+ * Coordinates are scaled by the cell width of each level, which makes
+ * every translation operator the same on every level, so they are built
+ * once per order. Each operator splits into a matrix acting on z powers
+ * and its conjugate acting on conj(z) powers, so it costs O(order^3).
+ */
+class FastMultipole{
+
+	public:
+		FastMultipole(float strength, float min_dist_sqr, int order):
+			strength(strength),
+			min_dist_sqr(min_dist_sqr)
+		{
+			set_order(order);
+		}
+
+		void set_order(int new_order){
+			order = std::max(new_order, 1);
+			terms = order + 1;
+			build_operators();
+		}
+
+		/*
+		 * Acceleration on every particle from every other particle. With a
+		 * pool, every pass after the tree build runs rows of cells in
+		 * parallel; each cell only writes its own expansions, or its own
+		 * children's, so the result does not depend on the split.
+		 */
+		void accelerations(const ParticleStore &particles, std::vector<float> &ax, std::vector<float> &ay,
+				ThreadPool *pool = nullptr){
+			const size_t count = particles.size();
+			ax.assign(count, 0.0f);
+			ay.assign(count, 0.0f);
+
+			if (count == 0){
+				return;
+			}
+
+			build_tree(particles);
+			upward_pass(pool);
+			interaction_pass(pool);
+			downward_pass(pool);
+			evaluate(ax, ay, pool);
+		}
+
+	private:
+		using Complex = std::complex<double>;
+
+		/*
+		 * ======================================
+		 * OPERATOR TABLES
+		 * ======================================
+		 */
+
+		/*
+		 * Every translation has the form
+		 *
+		 *   out[a][b] += scale * sum_i X[a][i] sum_j conj(X[b][j]) in[i][j]
+		 *
+		 * for some terms x terms matrix X.
+		 *
+		 *   M2M (child moments into parent, quadrant q):
+		 *     X[m][k] = C(m, k) 2^-k d^(m - k)
+		 *   L2L (parent local into child, quadrant q):
+		 *     X[s][k] = C(k, s) 2^-s d^(k - s)
+		 *   M2L (source cell moments into target cell local, offset D):
+		 *     X[k][m] = |D|^-1/2 a_m b(m, k) D^-(m + k)
+		 *
+		 * where d is the child centre offset in parent cell widths, D the
+		 * integer target - source offset in cell widths and
+		 * b(m, k) = binomial(-m - 1/2, k).
+		 */
+		void build_operators(){
+			std::vector<double> binomial(terms * terms, 0.0);
+			for (int n = 0; n < terms; n++){
+				binomial[n * terms] = 1.0;
+				for (int k = 1; k <= n; k++){
+					binomial[n * terms + k] = binomial[(n - 1) * terms + k - 1]
+						+ (k < n ? binomial[(n - 1) * terms + k] : 0.0);
+				}
+			}
+
+			// a_m = binomial(2m, m) / 4^m
+			std::vector<double> a(terms);
+			a[0] = 1.0;
+			for (int m = 1; m < terms; m++){
+				a[m] = a[m - 1] * (2.0 * m - 1.0) / (2.0 * m);
+			}
+
+			// b(m, k) = binomial(-m - 1/2, k)
+			std::vector<double> b(terms * terms);
+			for (int m = 0; m < terms; m++){
+				b[m * terms] = 1.0;
+				for (int k = 1; k < terms; k++){
+					b[m * terms + k] = b[m * terms + k - 1] * -(m + k - 0.5) / k;
+				}
+			}
+
+			const Complex quadrant_offsets[4] = {
+				Complex(-0.25, -0.25), Complex(0.25, -0.25), Complex(-0.25, 0.25), Complex(0.25, 0.25)
+			};
+
+			m2m_ops.assign(4 * terms * terms, Complex(0.0));
+			l2l_ops.assign(4 * terms * terms, Complex(0.0));
+			for (int q = 0; q < 4; q++){
+				std::vector<Complex> powers = complex_powers(quadrant_offsets[q], terms);
+				Complex *m2m = &m2m_ops[q * terms * terms];
+				Complex *l2l = &l2l_ops[q * terms * terms];
+
+				for (int m = 0; m < terms; m++){
+					for (int k = 0; k <= m; k++){
+						double c = binomial[m * terms + k] * std::ldexp(1.0, -k);
+						m2m[m * terms + k] = c * powers[m - k];
+						// Same coefficient, indexed the other way round for L2L
+						l2l[k * terms + m] = c * powers[m - k];
+					}
+				}
+			}
+
+			m2l_ops.assign(M2L_SPAN * M2L_SPAN * terms * terms, Complex(0.0));
+			for (int dy = -M2L_REACH; dy <= M2L_REACH; dy++){
+				for (int dx = -M2L_REACH; dx <= M2L_REACH; dx++){
+					if (std::abs(dx) <= 1 && std::abs(dy) <= 1){
+						continue;
+					}
+
+					Complex offset(dx, dy);
+					std::vector<Complex> inverse_powers = complex_powers(1.0 / offset, 2 * terms);
+					double root_inverse_abs = 1.0 / std::sqrt(std::abs(offset));
+
+					Complex *m2l = m2l_op(dx, dy);
+					for (int k = 0; k < terms; k++){
+						for (int m = 0; m < terms; m++){
+							m2l[k * terms + m] = root_inverse_abs * a[m] * b[m * terms + k] * inverse_powers[m + k];
+						}
+					}
+				}
+			}
+		}
+
+		static std::vector<Complex> complex_powers(Complex base, int count){
+			std::vector<Complex> powers(count);
+			powers[0] = 1.0;
+			for (int i = 1; i < count; i++){
+				powers[i] = powers[i - 1] * base;
+			}
+			return powers;
+		}
+
+		Complex *m2l_op(int dx, int dy){
+			return &m2l_ops[((dy + M2L_REACH) * M2L_SPAN + (dx + M2L_REACH)) * terms * terms];
+		}
+
+		/*
+		 * out[a][b] += scale * sum_i X[a][i] sum_j conj(X[b][j]) in[i][j], for a + b <= order.
+		 * partial holds terms x terms intermediates; every task passes its own.
+		 */
+		void apply_operator(const Complex *op, const Complex *in, Complex *out, double scale, Complex *partial){
+
+			for (int i = 0; i < terms; i++){
+				for (int b = 0; b < terms; b++){
+					Complex sum(0.0);
+					for (int j = 0; j < terms - i; j++){
+						sum += std::conj(op[b * terms + j]) * in[i * terms + j];
+					}
+					partial[i * terms + b] = sum;
+				}
+			}
+
+			for (int a = 0; a < terms; a++){
+				for (int b = 0; b < terms - a; b++){
+					Complex sum(0.0);
+					for (int i = 0; i < terms; i++){
+						sum += op[a * terms + i] * partial[i * terms + b];
+					}
+					out[a * terms + b] += scale * sum;
+				}
+			}
+		}
+
+		/*
+		 * ======================================
+		 * TREE
+		 * ======================================
+		 */
+
+		void build_tree(const ParticleStore &particles){
+			const size_t count = particles.size();
+			ParticleStore::ConstColumn x = particles.x();
+			ParticleStore::ConstColumn y = particles.y();
+
+			float min_x = x[0], max_x = x[0];
+			float min_y = y[0], max_y = y[0];
+			for (size_t i = 0; i < count; i++){
+				min_x = std::min(min_x, x[i]);
+				max_x = std::max(max_x, x[i]);
+				min_y = std::min(min_y, y[i]);
+				max_y = std::max(max_y, y[i]);
+			}
+
+			box_width = std::max(max_x - min_x, max_y - min_y) * 1.001 + 1e-6;
+			box_x = 0.5 * (min_x + max_x) - 0.5 * box_width;
+			box_y = 0.5 * (min_y + max_y) - 0.5 * box_width;
+
+			// Finest level considered: at most FINE_CELLS_PER_PARTICLE cells per particle
+			int fine_level = MIN_LEVEL;
+			while (fine_level < MAX_LEVEL && (size_t(1) << (2 * (fine_level + 1))) <= FINE_CELLS_PER_PARTICLE * count){
+				fine_level++;
+			}
+
+			// Occupancy of every level, from the fine histogram upwards
+			counts.resize(fine_level + 1);
+			const int fine_side = 1 << fine_level;
+			const double inv_fine_width = fine_side / box_width;
+
+			counts[fine_level].assign(size_t(fine_side) * fine_side, 0);
+			particle_cell.resize(count);
+			for (size_t i = 0; i < count; i++){
+				int ix = std::min(std::max(static_cast<int>((x[i] - box_x) * inv_fine_width), 0), fine_side - 1);
+				int iy = std::min(std::max(static_cast<int>((y[i] - box_y) * inv_fine_width), 0), fine_side - 1);
+				particle_cell[i] = iy * fine_side + ix;
+				counts[fine_level][particle_cell[i]]++;
+			}
+			for (int level = fine_level - 1; level >= MIN_LEVEL; level--){
+				const int side = 1 << level;
+				counts[level].assign(size_t(side) * side, 0);
+				for (int iy = 0; iy < side; iy++){
+					for (int ix = 0; ix < side; ix++){
+						uint32_t sum = 0;
+						for (int q = 0; q < 4; q++){
+							sum += counts[level + 1][child_index(level, ix, iy, q)];
+						}
+						counts[level][iy * side + ix] = sum;
+					}
+				}
+			}
+
+			leaf_level = choose_leaf_level(fine_level, count);
+
+			// Expansions are only stored for occupied cells
+			slots.resize(leaf_level + 1);
+			multipoles.resize(leaf_level + 1);
+			locals.resize(leaf_level + 1);
+			for (int level = MIN_LEVEL; level <= leaf_level; level++){
+				int32_t occupied = 0;
+				slots[level].resize(counts[level].size());
+				for (size_t c = 0; c < counts[level].size(); c++){
+					slots[level][c] = counts[level][c] > 0 ? occupied++ : -1;
+				}
+				multipoles[level].assign(size_t(occupied) * terms * terms, Complex(0.0));
+				locals[level].assign(size_t(occupied) * terms * terms, Complex(0.0));
+			}
+
+			// Counting sort of the particles into leaves
+			const int side = 1 << leaf_level;
+			const int shift = fine_level - leaf_level;
+
+			leaf_start.resize(size_t(side) * side + 1);
+			leaf_start[0] = 0;
+			for (size_t c = 0; c < counts[leaf_level].size(); c++){
+				leaf_start[c + 1] = leaf_start[c] + counts[leaf_level][c];
+			}
+
+			cursor.assign(leaf_start.begin(), leaf_start.end() - 1);
+			sorted.resize(count);
+			sx.resize(count);
+			sy.resize(count);
+			for (size_t i = 0; i < count; i++){
+				int ix = (particle_cell[i] % fine_side) >> shift;
+				int iy = (particle_cell[i] / fine_side) >> shift;
+				uint32_t slot = cursor[iy * side + ix]++;
+				sorted[slot] = static_cast<uint32_t>(i);
+				sx[slot] = x[i];
+				sy[slot] = y[i];
+			}
+		}
+
+		/*
+		 * Dense clusters make a fixed depth a poor fit: the core leaves fill
+		 * up and the near-field sum goes quadratic. The leaf level is picked
+		 * by estimated cost instead, counting one unit per near-field pair and
+		 * terms^3 units per M2L translation.
+		 *
+		 * Leaves are never narrower than the minimum distance. Cells that are
+		 * not neighbours are then at least that far apart, so the expansions
+		 * never take in a pair the direct sum would skip.
+		 */
+		int choose_leaf_level(int fine_level, size_t count) const{
+			const double m2l_cost = static_cast<double>(terms) * terms * terms;
+
+			int best_level = MIN_LEVEL;
+			double best_cost = 0.0;
+			double far_cost = 0.0;
+
+			for (int level = MIN_LEVEL; level <= fine_level; level++){
+				const double width = cell_width(level);
+				if (level > MIN_LEVEL && width * width < min_dist_sqr){
+					break;
+				}
+
+				const int side = 1 << level;
+				double near_cost = 0.0;
+				double occupied = 0.0;
+
+				for (int iy = 0; iy < side; iy++){
+					for (int ix = 0; ix < side; ix++){
+						uint32_t own = counts[level][iy * side + ix];
+						if (own == 0){
+							continue;
+						}
+						occupied++;
+
+						uint32_t neighbours = 0;
+						for (int ny = std::max(iy - 1, 0); ny <= std::min(iy + 1, side - 1); ny++){
+							for (int nx = std::max(ix - 1, 0); nx <= std::min(ix + 1, side - 1); nx++){
+								neighbours += counts[level][ny * side + nx];
+							}
+						}
+						near_cost += static_cast<double>(own) * neighbours;
+					}
+				}
+
+				far_cost += occupied * INTERACTION_LIST_SIZE * m2l_cost;
+				double cost = near_cost + far_cost + count * terms * terms;
+
+				if (level == MIN_LEVEL || cost < best_cost){
+					best_level = level;
+					best_cost = cost;
+				}
+			}
+
+			return best_level;
+		}
+
+		static int child_index(int level, int ix, int iy, int q){
+			const int child_side = 2 << level;
+			return (2 * iy + (q >> 1)) * child_side + 2 * ix + (q & 1);
+		}
+
+		double cell_width(int level) const{
+			return box_width / (1 << level);
+		}
+
+		Complex *multipole(int level, int32_t slot){
+			return &multipoles[level][size_t(slot) * terms * terms];
+		}
+
+		Complex *local(int level, int32_t slot){
+			return &locals[level][size_t(slot) * terms * terms];
+		}
+
+		/*
+		 * ======================================
+		 * PASSES
+		 * ======================================
+		 */
+
+		// P2M at the leaves, then M2M up to the coarsest level
+		void upward_pass(ThreadPool *pool){
+			const int side = 1 << leaf_level;
+			const double width = cell_width(leaf_level);
+			const double inv_width = 1.0 / width;
+
+			parallel_for(pool, 0, side, 1, [&](size_t row_begin, size_t row_end){
+				std::vector<Complex> powers(terms);
+				for (int iy = int(row_begin); iy < int(row_end); iy++){
+					for (int ix = 0; ix < side; ix++){
+						int c = iy * side + ix;
+						int32_t slot = slots[leaf_level][c];
+						if (slot < 0){
+							continue;
+						}
+						Complex *moments = multipole(leaf_level, slot);
+
+						Complex centre(box_x + (ix + 0.5) * width, box_y + (iy + 0.5) * width);
+						for (uint32_t k = leaf_start[c]; k < leaf_start[c + 1]; k++){
+							Complex w = (Complex(sx[k], sy[k]) - centre) * inv_width;
+							powers[0] = 1.0;
+							for (int m = 1; m < terms; m++){
+								powers[m] = powers[m - 1] * w;
+							}
+							for (int m = 0; m < terms; m++){
+								for (int n = 0; n < terms - m; n++){
+									moments[m * terms + n] += powers[m] * std::conj(powers[n]);
+								}
+							}
+						}
+					}
+				}
+			});
+
+			for (int level = leaf_level - 1; level >= MIN_LEVEL; level--){
+				const int level_side = 1 << level;
+				parallel_for(pool, 0, level_side, 1, [&](size_t row_begin, size_t row_end){
+					std::vector<Complex> partial(terms * terms);
+					for (int iy = int(row_begin); iy < int(row_end); iy++){
+						for (int ix = 0; ix < level_side; ix++){
+							int32_t slot = slots[level][iy * level_side + ix];
+							if (slot < 0){
+								continue;
+							}
+							for (int q = 0; q < 4; q++){
+								int32_t child_slot = slots[level + 1][child_index(level, ix, iy, q)];
+								if (child_slot >= 0){
+									apply_operator(&m2m_ops[q * terms * terms],
+											multipole(level + 1, child_slot), multipole(level, slot), 1.0, partial.data());
+								}
+							}
+						}
+					}
+				});
+			}
+		}
+
+		/*
+		 * M2L from the interaction list: children of the parent's neighbours
+		 * that are not adjacent to the cell itself. Adjacent cells are left
+		 * to finer levels, and at the leaves to the direct near-field sum.
+		 */
+		void interaction_pass(ThreadPool *pool){
+			for (int level = MIN_LEVEL; level <= leaf_level; level++){
+				const int side = 1 << level;
+				const double scale = 1.0 / cell_width(level);
+
+				parallel_for(pool, 0, side, 1, [&](size_t row_begin, size_t row_end){
+					std::vector<Complex> partial(terms * terms);
+					for (int iy = int(row_begin); iy < int(row_end); iy++){
+						for (int ix = 0; ix < side; ix++){
+							int32_t slot = slots[level][iy * side + ix];
+							if (slot < 0){
+								continue;
+							}
+
+							int first_x = std::max(2 * (ix / 2 - 1), 0);
+							int last_x = std::min(2 * (ix / 2 + 1) + 1, side - 1);
+							int first_y = std::max(2 * (iy / 2 - 1), 0);
+							int last_y = std::min(2 * (iy / 2 + 1) + 1, side - 1);
+
+							for (int jy = first_y; jy <= last_y; jy++){
+								for (int jx = first_x; jx <= last_x; jx++){
+									if (std::abs(jx - ix) <= 1 && std::abs(jy - iy) <= 1){
+										continue;
+									}
+									int32_t source_slot = slots[level][jy * side + jx];
+									if (source_slot < 0){
+										continue;
+									}
+									apply_operator(m2l_op(ix - jx, iy - jy),
+											multipole(level, source_slot), local(level, slot), scale, partial.data());
+								}
+							}
+						}
+					}
+				});
+			}
+		}
+
+		// L2L from every cell into its children
+		void downward_pass(ThreadPool *pool){
+			for (int level = MIN_LEVEL; level < leaf_level; level++){
+				const int side = 1 << level;
+				parallel_for(pool, 0, side, 1, [&](size_t row_begin, size_t row_end){
+					std::vector<Complex> partial(terms * terms);
+					for (int iy = int(row_begin); iy < int(row_end); iy++){
+						for (int ix = 0; ix < side; ix++){
+							int32_t slot = slots[level][iy * side + ix];
+							if (slot < 0){
+								continue;
+							}
+							for (int q = 0; q < 4; q++){
+								int32_t child_slot = slots[level + 1][child_index(level, ix, iy, q)];
+								if (child_slot >= 0){
+									apply_operator(&l2l_ops[q * terms * terms],
+											local(level, slot), local(level + 1, child_slot), 1.0, partial.data());
+								}
+							}
+						}
+					}
+				});
+			}
+		}
+
+		/*
+		 * Far field from the leaf's local expansion plus a direct sum over
+		 * the leaf and its 8 neighbours. The gradient of the real potential
+		 * phi is (2 Re(dphi/du), -2 Im(dphi/du)).
+		 */
+		void evaluate(std::vector<float> &ax, std::vector<float> &ay, ThreadPool *pool){
+			const int side = 1 << leaf_level;
+			const double width = cell_width(leaf_level);
+			const double inv_width = 1.0 / width;
+
+			parallel_for(pool, 0, side, 1, [&](size_t row_begin, size_t row_end){
+				std::vector<Complex> powers(terms);
+				for (int iy = int(row_begin); iy < int(row_end); iy++){
+					for (int ix = 0; ix < side; ix++){
+						int c = iy * side + ix;
+						int32_t slot = slots[leaf_level][c];
+						if (slot < 0){
+							continue;
+						}
+						const Complex *expansion = local(leaf_level, slot);
+						Complex centre(box_x + (ix + 0.5) * width, box_y + (iy + 0.5) * width);
+
+						for (uint32_t k = leaf_start[c]; k < leaf_start[c + 1]; k++){
+							Complex u = (Complex(sx[k], sy[k]) - centre) * inv_width;
+							powers[0] = 1.0;
+							for (int m = 1; m < terms; m++){
+								powers[m] = powers[m - 1] * u;
+							}
+
+							Complex gradient(0.0);
+							for (int m = 1; m < terms; m++){
+								for (int n = 0; n < terms - m; n++){
+									gradient += static_cast<double>(m) * expansion[m * terms + n]
+										* powers[m - 1] * std::conj(powers[n]);
+								}
+							}
+							gradient *= inv_width;
+
+							float sum_x = static_cast<float>(2.0 * gradient.real());
+							float sum_y = static_cast<float>(-2.0 * gradient.imag());
+
+							for (int ny = std::max(iy - 1, 0); ny <= std::min(iy + 1, side - 1); ny++){
+								for (int nx = std::max(ix - 1, 0); nx <= std::min(ix + 1, side - 1); nx++){
+									int n = ny * side + nx;
+									for (uint32_t j = leaf_start[n]; j < leaf_start[n + 1]; j++){
+										float dist_x = sx[j] - sx[k];
+										float dist_y = sy[j] - sy[k];
+										float dist_sqr = (dist_x * dist_x) + (dist_y * dist_y);
+										if (dist_sqr > min_dist_sqr){
+											float dist = std::sqrt(dist_sqr);
+											float force = 1.0f / dist_sqr;
+											sum_x += (dist_x / dist) * force;
+											sum_y += (dist_y / dist) * force;
+										}
+									}
+								}
+							}
+
+							ax[sorted[k]] = strength * sum_x;
+							ay[sorted[k]] = strength * sum_y;
+						}
+					}
+				}
+			});
+		}
+
+		static const int MIN_LEVEL = 2;
+		static const int MAX_LEVEL = 10;
+		static const size_t FINE_CELLS_PER_PARTICLE = 16;
+		static const int INTERACTION_LIST_SIZE = 27;
+		static const int M2L_REACH = 3;
+		static const int M2L_SPAN = 2 * M2L_REACH + 1;
+
+		float strength;
+		float min_dist_sqr;
+		int order;
+		int terms;
+
+		std::vector<Complex> m2m_ops;
+		std::vector<Complex> l2l_ops;
+		std::vector<Complex> m2l_ops;
+
+		// Bounding square of the current tick
+		double box_x, box_y, box_width;
+		int leaf_level;
+
+		// Particles per cell on every level up to the finest one considered
+		std::vector<std::vector<uint32_t>> counts;
+
+		// Index of each occupied cell's expansions, -1 for empty cells
+		std::vector<std::vector<int32_t>> slots;
+
+		// Expansions per level, terms x terms coefficients per occupied cell
+		std::vector<std::vector<Complex>> multipoles;
+		std::vector<std::vector<Complex>> locals;
+
+		// Particles sorted by leaf
+		std::vector<uint32_t> particle_cell;
+		std::vector<uint32_t> leaf_start;
+		std::vector<uint32_t> cursor;
+		std::vector<uint32_t> sorted;
+		std::vector<float> sx;
+		std::vector<float> sy;
+};
+
+#endif
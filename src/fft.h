@@ -0,0 +1,93 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <vector>
+#include <complex>
+#include <cstddef>
+#include <cmath>
+#include <utility>
+
+/*
+ * Iterative radix-2 FFT for power-of-two sizes.
+ *
+ * Twiddles and the bit-reversal permutation are computed once per size.
+ * The transform is unnormalised in both directions: a forward transform
+ * followed by an inverse one scales the data by n.
+ */
+class Fft{
+
+	public:
+		using Complex = std::complex<float>;
+
+		Fft(size_t n = 1){
+			resize(n);
+		}
+
+		void resize(size_t new_n){
+			n = new_n;
+
+			bits = 0;
+			while ((size_t(1) << bits) < n){
+				bits++;
+			}
+
+			reversed.resize(n);
+			for (size_t i = 0; i < n; i++){
+				size_t r = 0;
+				for (size_t b = 0; b < bits; b++){
+					r |= ((i >> b) & 1) << (bits - 1 - b);
+				}
+				reversed[i] = r;
+			}
+
+			// Twiddles in double so the error does not grow with n
+			twiddles.resize(n / 2);
+			for (size_t k = 0; k < n / 2; k++){
+				double angle = -2.0 * M_PI * static_cast<double>(k) / static_cast<double>(n);
+				twiddles[k] = Complex(static_cast<float>(std::cos(angle)), static_cast<float>(std::sin(angle)));
+			}
+		}
+
+		size_t size() const{
+			return n;
+		}
+
+		// In-place transform of n contiguous values
+		void transform(Complex *data, bool inverse) const{
+			for (size_t i = 0; i < n; i++){
+				if (i < reversed[i]){
+					std::swap(data[i], data[reversed[i]]);
+				}
+			}
+
+			for (size_t length = 2; length <= n; length <<= 1){
+				size_t half = length / 2;
+				size_t stride = n / length;
+
+				for (size_t start = 0; start < n; start += length){
+					for (size_t k = 0; k < half; k++){
+						Complex w = twiddles[k * stride];
+						if (inverse){
+							w = std::conj(w);
+						}
+
+						// Written out: operator* on std::complex adds NaN/Inf checks
+						Complex even = data[start + k];
+						Complex b = data[start + k + half];
+						Complex odd(b.real() * w.real() - b.imag() * w.imag(),
+								b.real() * w.imag() + b.imag() * w.real());
+						data[start + k] = even + odd;
+						data[start + k + half] = even - odd;
+					}
+				}
+			}
+		}
+
+	private:
+		size_t n;
+		size_t bits;
+		std::vector<size_t> reversed;
+		std::vector<Complex> twiddles;
+};
+
+#endif
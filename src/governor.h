@@ -0,0 +1,211 @@
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <algorithm>
+
+#include "simulation_settings.h"
+
+struct GovernorSettings{
+	// Most ticks run to catch up in one batch; the rest of the backlog is dropped
+	size_t max_substeps = 4;
+
+	/*
+	 * Load is the wall time spent simulating over the simulated time it
+	 * covered, measured over windows of window_ticks ticks. Above
+	 * overload_load, or with ticks dropped, for overload_windows windows
+	 * in a row, the governor steps down one level. Below recover_load for
+	 * recover_windows windows in a row it steps back up.
+	 */
+	size_t window_ticks = 60;
+	double overload_load = 0.9;
+	size_t overload_windows = 2;
+	double recover_load = 0.5;
+	size_t recover_windows = 5;
+
+	/*
+	 * Theta used once the governor has to coarsen the Barnes-Hut walk.
+	 * The worst particle's error grows fast with theta: on the collapsed
+	 * cluster it is about 2% of the largest acceleration at the default
+	 * 0.5, 7% at 0.7 and 15% at 1.0. 0.7 keeps the coarse level within a
+	 * few times the default's error.
+	 */
+	float coarse_theta = 0.7f;
+};
+
+// What the simulation runs with at one level of the governor
+struct GovernorLevel{
+	Solver solver;
+	float theta;
+	size_t max_substeps;
+	std::string name;
+};
+
+/*
+ * Keeps a fixed-timestep loop from falling into the spiral of death, where
+ * each slow batch leaves more ticks due for the next one and the loop never
+ * catches up.
+ *
+ * Each batch is capped at the current level's substeps, and ticks past the
+ * cap are dropped: the simulation falls behind wall time instead of trying
+ * to catch up. Dropped time is counted and logged.
+ *
+ * Under sustained overload the governor walks down a ladder of cheaper
+ * levels, built from the starting settings:
+ *
+ *   0. as configured
+ *   1. Barnes-Hut instead of the direct sum
+ *   2. a coarser Barnes-Hut opening angle
+ *   3. one substep per batch
+ *
+ * Levels that change nothing for the configured solver are left out. Once
+ * load falls it climbs back one level at a time. A level that overloads
+ * again soon after being restored is held off twice as long before the
+ * next try, so a scene right on the edge does not flap between two levels.
+ *
+ * Every decision is written to std::cout.
+ */
+class Governor{
+
+	public:
+		Governor(const SimulationSettings &simulation, double dt, GovernorSettings settings = GovernorSettings()):
+			settings(settings),
+			dt(dt),
+			recover_after(settings.recover_windows)
+		{
+			GovernorLevel level{simulation.solver, simulation.theta, std::max<size_t>(settings.max_substeps, 1),
+					"as configured"};
+			levels.push_back(level);
+
+			if (level.solver == Solver::Direct){
+				level.solver = Solver::BarnesHut;
+				level.name = "Barnes-Hut instead of direct";
+				levels.push_back(level);
+			}
+			if (level.solver == Solver::BarnesHut && level.theta < settings.coarse_theta){
+				level.theta = settings.coarse_theta;
+				level.name = "coarser Barnes-Hut opening angle";
+				levels.push_back(level);
+			}
+			if (level.max_substeps > 1){
+				level.max_substeps = 1;
+				level.name = "one substep per batch";
+				levels.push_back(level);
+			}
+		}
+
+		/*
+		 * Ticks to run now out of the `due` that have come up; the rest are
+		 * dropped and the caller should skip their time.
+		 */
+		size_t begin_batch(size_t due){
+			size_t run = std::min(due, levels[current].max_substeps);
+			size_t dropped = due - run;
+			if (dropped > 0){
+				window_dropped += dropped;
+				dropped_ticks += dropped;
+				std::cout << "governor: dropped " << dropped << " ticks (" << dropped * dt * 1000.0
+					<< " ms), " << get_dropped_seconds() << " s in total\n";
+			}
+			return run;
+		}
+
+		/*
+		 * Reports that the batch took `seconds` of wall time to run `ticks`
+		 * ticks. Returns true when the level has changed, and the caller
+		 * should apply get_level() to the simulation.
+		 */
+		bool end_batch(double seconds, size_t ticks){
+			window_seconds += seconds;
+			window_ticks += ticks;
+			if (window_ticks < settings.window_ticks){
+				return false;
+			}
+
+			const double load = window_seconds / (window_ticks * dt);
+			const bool overloaded = load > settings.overload_load || window_dropped > 0;
+			const bool idle = load < settings.recover_load && window_dropped == 0;
+			window_seconds = 0.0;
+			window_ticks = 0;
+			window_dropped = 0;
+			windows_at_level++;
+
+			over_streak = overloaded ? over_streak + 1 : 0;
+			under_streak = idle ? under_streak + 1 : 0;
+
+			// A restored level that has held for a while counts as recovered
+			if (restored && windows_at_level > 2 * recover_after){
+				restored = false;
+				recover_after = settings.recover_windows;
+			}
+
+			if (over_streak >= settings.overload_windows && current + 1 < levels.size()){
+				// Falling straight back from a level we just climbed to: wait longer next time
+				if (restored){
+					restored = false;
+					recover_after *= 2;
+				}
+				return change_level(current + 1, load, "overloaded");
+			}
+
+			if (under_streak >= recover_after && current > 0){
+				restored = true;
+				return change_level(current - 1, load, "load dropped");
+			}
+			return false;
+		}
+
+		const GovernorLevel &get_level() const{
+			return levels[current];
+		}
+
+		size_t get_level_index() const{
+			return current;
+		}
+
+		size_t get_dropped_ticks() const{
+			return dropped_ticks;
+		}
+
+		double get_dropped_seconds() const{
+			return dropped_ticks * dt;
+		}
+
+	private:
+		bool change_level(size_t level, double load, const char *reason){
+			std::cout << "governor: " << reason << " (load " << load << "), level " << current
+				<< " -> " << level << ": " << levels[level].name << "\n";
+			current = level;
+			over_streak = 0;
+			under_streak = 0;
+			windows_at_level = 0;
+			return true;
+		}
+
+		GovernorSettings settings;
+		double dt;
+
+		std::vector<GovernorLevel> levels;
+		size_t current = 0;
+
+		// Current window
+		double window_seconds = 0.0;
+		size_t window_ticks = 0;
+		size_t window_dropped = 0;
+
+		// Windows in a row above / below the thresholds, and since the last change
+		size_t over_streak = 0;
+		size_t under_streak = 0;
+		size_t windows_at_level = 0;
+
+		// Quiet windows needed before stepping up, doubled after a failed recovery
+		size_t recover_after;
+		bool restored = false;
+
+		size_t dropped_ticks = 0;
+};
+
+#endif
@@ -0,0 +1,148 @@
+#ifndef HARDWARE_INFO_H
+#define HARDWARE_INFO_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <set>
+#include <utility>
+#include <thread>
+#include <cstdlib>
+
+/*
+ * What the measuring programs record about the machine they ran on, read
+ * from Linux's sysfs and /proc. Anything that cannot be read is left at
+ * its default, so the programs still run elsewhere.
+ */
+
+struct CpuFrequency{
+	std::string governor = "unknown";
+	double mhz = 0.0;	// mean over the CPUs, 0 when cpufreq is not there
+};
+
+struct CacheInfo{
+	int level = 0;
+	std::string type;	// Data, Instruction or Unified
+	long size_kb = 0;
+	int line_bytes = 0;
+};
+
+struct HardwareInfo{
+	std::string model = "unknown";
+	int logical_cpus = 0;
+	int cores = 0;		// physical cores, 0 when the topology is not there
+	int packages = 0;
+	int threads_per_core = 0;
+	bool smt_active = false;
+	std::vector<CacheInfo> caches;	// as seen from CPU 0
+};
+
+inline std::string cpu_path(int cpu, const std::string &rest){
+	return "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/" + rest;
+}
+
+// Reads the cpufreq governor of CPU 0 and the mean current clock of every CPU
+inline CpuFrequency read_cpu_frequency(){
+	CpuFrequency frequency;
+	std::ifstream governor(cpu_path(0, "cpufreq/scaling_governor"));
+	if (governor){
+		governor >> frequency.governor;
+	}
+
+	double total_khz = 0.0;
+	int cpus = 0;
+	while (true){
+		std::ifstream current(cpu_path(cpus, "cpufreq/scaling_cur_freq"));
+		double khz = 0.0;
+		if (!(current >> khz)){
+			break;
+		}
+		total_khz += khz;
+		cpus++;
+	}
+	frequency.mhz = cpus > 0 ? total_khz / cpus / 1000.0 : 0.0;
+	return frequency;
+}
+
+inline HardwareInfo read_hardware_info(){
+	HardwareInfo info;
+	info.logical_cpus = static_cast<int>(std::thread::hardware_concurrency());
+
+	std::ifstream cpuinfo("/proc/cpuinfo");
+	std::string line;
+	while (std::getline(cpuinfo, line)){
+		if (line.compare(0, 10, "model name") == 0){
+			size_t colon = line.find(':');
+			if (colon != std::string::npos && colon + 2 <= line.size()){
+				info.model = line.substr(colon + 2);
+			}
+			break;
+		}
+	}
+
+	// A core is a distinct (package, core id) pair over the CPUs
+	std::set<std::pair<int, int>> cores;
+	std::set<int> packages;
+	for (int cpu = 0; cpu < info.logical_cpus; cpu++){
+		std::ifstream package(cpu_path(cpu, "topology/physical_package_id"));
+		std::ifstream core(cpu_path(cpu, "topology/core_id"));
+		int package_id = 0;
+		int core_id = 0;
+		if (!(package >> package_id) || !(core >> core_id)){
+			cores.clear();
+			packages.clear();
+			break;
+		}
+		cores.insert(std::make_pair(package_id, core_id));
+		packages.insert(package_id);
+	}
+	info.cores = static_cast<int>(cores.size());
+	info.packages = static_cast<int>(packages.size());
+	info.threads_per_core = info.cores > 0 ? info.logical_cpus / info.cores : 0;
+
+	std::ifstream smt("/sys/devices/system/cpu/smt/active");
+	int active = 0;
+	if (smt >> active){
+		info.smt_active = active != 0;
+	} else{
+		info.smt_active = info.threads_per_core > 1;
+	}
+
+	for (int index = 0; ; index++){
+		const std::string dir = "cache/index" + std::to_string(index) + "/";
+		std::ifstream level(cpu_path(0, dir + "level"));
+		CacheInfo cache;
+		if (!(level >> cache.level)){
+			break;
+		}
+		std::ifstream type(cpu_path(0, dir + "type"));
+		type >> cache.type;
+
+		// Sizes read like "48K"
+		std::ifstream size(cpu_path(0, dir + "size"));
+		std::string text;
+		if (size >> text){
+			cache.size_kb = std::atol(text.c_str());
+			if (!text.empty() && text.back() == 'M'){
+				cache.size_kb *= 1024;
+			}
+		}
+		std::ifstream line_size(cpu_path(0, dir + "coherency_line_size"));
+		line_size >> cache.line_bytes;
+		info.caches.push_back(cache);
+	}
+	return info;
+}
+
+// "L1d", "L1i", "L2" and so on
+inline std::string cache_name(const CacheInfo &cache){
+	std::string name = "L" + std::to_string(cache.level);
+	if (cache.type == "Data"){
+		name += "d";
+	} else if (cache.type == "Instruction"){
+		name += "i";
+	}
+	return name;
+}
+
+#endif
@@ -0,0 +1,138 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include "simulation.h"
+#include "command_line.h"
+#include "profiler.h"
+
+/*
+ * Runs the simulation with no window as fast as it will go, for machines
+ * without a display. Everything the GL viewer hard-codes is taken from the
+ * command line, and the run ends with its throughput.
+ */
+
+const double FIXED_DT = 1.0f / 60.0f;
+
+struct HeadlessOptions{
+	int count = 10000;
+	long ticks = 600;
+	const ScenarioInfo *scenario = find_scenario("uniform");
+	std::string trace;
+	SimulationSettings settings;
+};
+
+void print_usage(const char *program){
+	std::cout << "Usage: " << program << " [options]\n"
+		<< "  --count N        particles (default 10000)\n"
+		<< "  --ticks N        ticks to run (default 600)\n"
+		<< "  --seed N         seed, 0 for a random one (default 0)\n"
+		<< "  --solver NAME    direct, barnes-hut, fmm or mesh (default direct)\n"
+		<< "  --threads N      worker threads, 0 for one per hardware thread (default 0)\n"
+		<< "  --trace FILE     profile the run into a Chrome trace, and print p50 / p99 per phase\n"
+		<< "  --scenario NAME  starting state (default uniform), one of:\n";
+	print_scenarios(std::cout);
+}
+
+// Fills options from argv; prints what is wrong and returns false on bad input
+bool parse_options(int argc, char **argv, HeadlessOptions &options){
+	for (int a = 1; a < argc; a++){
+		std::string flag = argv[a];
+		if (flag == "--help" || flag == "-h"){
+			print_usage(argv[0]);
+			std::exit(0);
+		}
+		if (a + 1 >= argc){
+			std::cerr << "Missing value for " << flag << "\n";
+			return false;
+		}
+		const char *value = argv[++a];
+
+		long number = 0;
+		bool ok = true;
+		if (flag == "--count"){
+			ok = parse_number(value, 1, number, INT_MAX);
+			options.count = static_cast<int>(number);
+		} else if (flag == "--ticks"){
+			ok = parse_number(value, 1, number);
+			options.ticks = number;
+		} else if (flag == "--seed"){
+			ok = parse_seed(value, options.settings.seed);
+		} else if (flag == "--solver"){
+			ok = parse_solver(value, options.settings.solver);
+		} else if (flag == "--threads"){
+			ok = parse_number(value, 0, number, INT_MAX);
+			options.settings.threads = static_cast<int>(number);
+		} else if (flag == "--trace"){
+			options.trace = value;
+		} else if (flag == "--scenario"){
+			options.scenario = find_scenario(value);
+			ok = options.scenario != nullptr;
+		} else{
+			std::cerr << "Unknown option " << flag << "\n";
+			return false;
+		}
+
+		if (!ok){
+			std::cerr << "Bad value for " << flag << ": " << value << "\n";
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char **argv){
+	HeadlessOptions options;
+	if (!parse_options(argc, argv, options)){
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	// The scenario is drawn from the seed too, so pick it here when none is given
+	if (options.settings.seed == 0){
+		std::random_device device;
+		options.settings.seed = (uint64_t(device()) << 32) | device();
+	}
+
+	Simulation sim(build_scenario(*options.scenario, options.count, options.settings.seed, options.settings.threads),
+			options.settings);
+	std::cout << "particles " << options.count << ", ticks " << options.ticks
+		<< ", scenario " << options.scenario->name
+		<< ", solver " << solver_name(options.settings.solver)
+		<< ", threads " << sim.get_thread_count()
+		<< ", simd " << simd_level_name(sim.get_simd_level())
+		<< ", seed " << sim.get_seed() << "\n";
+
+	if (!options.trace.empty()){
+		Profiler::set_thread_name("main");
+		Profiler::enable();
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	for (long t = 0; t < options.ticks; t++){
+		sim.update_particles(FIXED_DT);
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	/*
+	 * Pair interactions are counted as all n (n - 1) / 2 pairs per tick
+	 * whatever the solver, so the approximate solvers read as the direct
+	 * sum they stand in for.
+	 */
+	const double seconds = elapsed.count();
+	const double pairs = 0.5 * double(options.count) * double(options.count - 1);
+	std::cout << "elapsed " << seconds << " s\n"
+		<< "ticks/s " << options.ticks / seconds << "\n"
+		<< "pair interactions/s " << pairs * options.ticks / seconds << "\n";
+
+	if (!options.trace.empty()){
+		Profiler::disable();
+		Profiler::print_summary(std::cout, 0.0);
+		if (!Profiler::write_trace(options.trace)){
+			std::cerr << "Cannot write " << options.trace << "\n";
+			return 1;
+		}
+	}
+	return 0;
+}
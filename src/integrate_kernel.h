@@ -0,0 +1,256 @@
+#ifndef INTEGRATE_KERNEL_H
+#define INTEGRATE_KERNEL_H
+
+#include <cstddef>
+#include <algorithm>
+
+#include "simd_level.h"
+
+// Per-particle forces and the step length for one tick
+struct StepParams{
+	float dt;
+	float gravity;
+	float wind_x;
+	float wind_y;
+	float pull;
+};
+
+/*
+ * One pass over the particles that applies gravity, wind and the pull to
+ * the centre, moves each particle by its velocity and bounces it off the
+ * walls at +-1.
+ *
+ * The store is given as blocks of `width` particles, block b starting
+ * b * stride floats after x (and likewise for y, vx and vy), which covers
+ * both the SoA arrays and AoSoA blocks. Only the first `count` particles
+ * are touched, so padding stays zero. noise_x / noise_y are plain arrays of
+ * count wind-noise samples.
+ */
+using StepKernel = void (*)(float *x, float *y, float *vx, float *vy,
+		const float *noise_x, const float *noise_y,
+		size_t count, size_t width, size_t stride, const StepParams &params);
+
+/*
+ * The reference the vector kernels are held to. Built with -march flags
+ * the compiler could fuse its multiplies and adds into FMA, so contraction
+ * is switched off here as well.
+ */
+__attribute__((optimize("fp-contract=off")))
+inline void step_scalar(float *x, float *y, float *vx, float *vy,
+		const float *noise_x, const float *noise_y,
+		size_t count, size_t width, size_t stride, const StepParams &params){
+
+	const float dt = params.dt;
+	const float gravity_dt = -params.gravity * dt;
+
+	for (size_t first = 0, offset = 0; first < count; first += width, offset += stride){
+		float *bx = x + offset;
+		float *by = y + offset;
+		float *bvx = vx + offset;
+		float *bvy = vy + offset;
+		const size_t lanes = std::min(width, count - first);
+
+		for (size_t k = 0; k < lanes; k++){
+			// Gravity
+			bvy[k] += gravity_dt;
+
+			// Wind
+			bvx[k] += (params.wind_x + noise_x[first + k]) * dt;
+			bvy[k] += (params.wind_y + noise_y[first + k]) * dt;
+
+			// Attract to center
+			float dx = 0.0f - bx[k];
+			float dy = 0.0f - by[k];
+			bvx[k] += dx * params.pull * dt;
+			bvy[k] += dy * params.pull * dt;
+
+			bx[k] += bvx[k] * dt;
+			by[k] += bvy[k] * dt;
+
+			// Bounce off walls
+			if (bx[k] >= 1.0f && bvx[k] > 0.0f){
+				bx[k] = 1.0f;
+				bvx[k] = -bvx[k];
+			}
+			if (bx[k] <= -1.0f && bvx[k] < 0.0f){
+				bx[k] = -1.0f;
+				bvx[k] = -bvx[k];
+			}
+			if (by[k] >= 1.0f && bvy[k] > 0.0f){
+				by[k] = 1.0f;
+				bvy[k] = -bvy[k];
+			}
+			if (by[k] <= -1.0f && bvy[k] < 0.0f){
+				by[k] = -1.0f;
+				bvy[k] = -bvy[k];
+			}
+		}
+	}
+}
+
+#if SIMD_X86
+
+/*
+ * The vector versions do the same operations in the same order, one lane
+ * per particle, so they match step_scalar bit for bit. Each wall test is a
+ * mask: where it holds, the position is replaced by the wall and the
+ * velocity's sign is flipped, elsewhere both pass through unchanged. The
+ * tests run in the scalar order, each on the output of the one before.
+ *
+ * Multiplies and adds are kept as separate instructions: fusing them would
+ * round differently from the scalar code, so contraction into FMA is
+ * switched off for these two functions, as for step_scalar.
+ */
+__attribute__((target("avx2,fma"), optimize("fp-contract=off")))
+inline void step_avx2(float *x, float *y, float *vx, float *vy,
+		const float *noise_x, const float *noise_y,
+		size_t count, size_t width, size_t stride, const StepParams &params){
+
+	const __m256 dt = _mm256_set1_ps(params.dt);
+	const __m256 gravity_dt = _mm256_set1_ps(-params.gravity * params.dt);
+	const __m256 wind_x = _mm256_set1_ps(params.wind_x);
+	const __m256 wind_y = _mm256_set1_ps(params.wind_y);
+	const __m256 pull = _mm256_set1_ps(params.pull);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 minus_one = _mm256_set1_ps(-1.0f);
+	const __m256 sign = _mm256_set1_ps(-0.0f);
+	const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+	for (size_t first = 0, offset = 0; first < count; first += width, offset += stride){
+		const size_t lanes = std::min(width, count - first);
+
+		for (size_t k = 0; k < lanes; k += 8){
+			__m256i live = _mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(lanes - k)), lane);
+			float *px = x + offset + k;
+			float *py = y + offset + k;
+			float *pvx = vx + offset + k;
+			float *pvy = vy + offset + k;
+
+			__m256 bx = _mm256_maskload_ps(px, live);
+			__m256 by = _mm256_maskload_ps(py, live);
+			__m256 bvx = _mm256_maskload_ps(pvx, live);
+			__m256 bvy = _mm256_maskload_ps(pvy, live);
+			__m256 nx = _mm256_maskload_ps(noise_x + first + k, live);
+			__m256 ny = _mm256_maskload_ps(noise_y + first + k, live);
+
+			bvy = _mm256_add_ps(bvy, gravity_dt);
+			bvx = _mm256_add_ps(bvx, _mm256_mul_ps(_mm256_add_ps(wind_x, nx), dt));
+			bvy = _mm256_add_ps(bvy, _mm256_mul_ps(_mm256_add_ps(wind_y, ny), dt));
+
+			__m256 dx = _mm256_sub_ps(zero, bx);
+			__m256 dy = _mm256_sub_ps(zero, by);
+			bvx = _mm256_add_ps(bvx, _mm256_mul_ps(_mm256_mul_ps(dx, pull), dt));
+			bvy = _mm256_add_ps(bvy, _mm256_mul_ps(_mm256_mul_ps(dy, pull), dt));
+
+			bx = _mm256_add_ps(bx, _mm256_mul_ps(bvx, dt));
+			by = _mm256_add_ps(by, _mm256_mul_ps(bvy, dt));
+
+			__m256 hit = _mm256_and_ps(_mm256_cmp_ps(bx, one, _CMP_GE_OQ), _mm256_cmp_ps(bvx, zero, _CMP_GT_OQ));
+			bx = _mm256_blendv_ps(bx, one, hit);
+			bvx = _mm256_xor_ps(bvx, _mm256_and_ps(hit, sign));
+
+			hit = _mm256_and_ps(_mm256_cmp_ps(bx, minus_one, _CMP_LE_OQ), _mm256_cmp_ps(bvx, zero, _CMP_LT_OQ));
+			bx = _mm256_blendv_ps(bx, minus_one, hit);
+			bvx = _mm256_xor_ps(bvx, _mm256_and_ps(hit, sign));
+
+			hit = _mm256_and_ps(_mm256_cmp_ps(by, one, _CMP_GE_OQ), _mm256_cmp_ps(bvy, zero, _CMP_GT_OQ));
+			by = _mm256_blendv_ps(by, one, hit);
+			bvy = _mm256_xor_ps(bvy, _mm256_and_ps(hit, sign));
+
+			hit = _mm256_and_ps(_mm256_cmp_ps(by, minus_one, _CMP_LE_OQ), _mm256_cmp_ps(bvy, zero, _CMP_LT_OQ));
+			by = _mm256_blendv_ps(by, minus_one, hit);
+			bvy = _mm256_xor_ps(bvy, _mm256_and_ps(hit, sign));
+
+			_mm256_maskstore_ps(px, live, bx);
+			_mm256_maskstore_ps(py, live, by);
+			_mm256_maskstore_ps(pvx, live, bvx);
+			_mm256_maskstore_ps(pvy, live, bvy);
+		}
+	}
+}
+
+__attribute__((target("avx512f"), optimize("fp-contract=off")))
+inline void step_avx512(float *x, float *y, float *vx, float *vy,
+		const float *noise_x, const float *noise_y,
+		size_t count, size_t width, size_t stride, const StepParams &params){
+
+	const __m512 dt = _mm512_set1_ps(params.dt);
+	const __m512 gravity_dt = _mm512_set1_ps(-params.gravity * params.dt);
+	const __m512 wind_x = _mm512_set1_ps(params.wind_x);
+	const __m512 wind_y = _mm512_set1_ps(params.wind_y);
+	const __m512 pull = _mm512_set1_ps(params.pull);
+	const __m512 zero = _mm512_setzero_ps();
+	const __m512 one = _mm512_set1_ps(1.0f);
+	const __m512 minus_one = _mm512_set1_ps(-1.0f);
+
+	for (size_t first = 0, offset = 0; first < count; first += width, offset += stride){
+		const size_t lanes = std::min(width, count - first);
+
+		for (size_t k = 0; k < lanes; k += 16){
+			__mmask16 live = lanes - k >= 16 ? __mmask16(0xffff) : __mmask16((1u << (lanes - k)) - 1);
+			float *px = x + offset + k;
+			float *py = y + offset + k;
+			float *pvx = vx + offset + k;
+			float *pvy = vy + offset + k;
+
+			__m512 bx = _mm512_maskz_loadu_ps(live, px);
+			__m512 by = _mm512_maskz_loadu_ps(live, py);
+			__m512 bvx = _mm512_maskz_loadu_ps(live, pvx);
+			__m512 bvy = _mm512_maskz_loadu_ps(live, pvy);
+			__m512 nx = _mm512_maskz_loadu_ps(live, noise_x + first + k);
+			__m512 ny = _mm512_maskz_loadu_ps(live, noise_y + first + k);
+
+			bvy = _mm512_add_ps(bvy, gravity_dt);
+			bvx = _mm512_add_ps(bvx, _mm512_mul_ps(_mm512_add_ps(wind_x, nx), dt));
+			bvy = _mm512_add_ps(bvy, _mm512_mul_ps(_mm512_add_ps(wind_y, ny), dt));
+
+			__m512 dx = _mm512_sub_ps(zero, bx);
+			__m512 dy = _mm512_sub_ps(zero, by);
+			bvx = _mm512_add_ps(bvx, _mm512_mul_ps(_mm512_mul_ps(dx, pull), dt));
+			bvy = _mm512_add_ps(bvy, _mm512_mul_ps(_mm512_mul_ps(dy, pull), dt));
+
+			bx = _mm512_add_ps(bx, _mm512_mul_ps(bvx, dt));
+			by = _mm512_add_ps(by, _mm512_mul_ps(bvy, dt));
+
+			__mmask16 hit = _mm512_cmp_ps_mask(bx, one, _CMP_GE_OQ) & _mm512_cmp_ps_mask(bvx, zero, _CMP_GT_OQ);
+			bx = _mm512_mask_mov_ps(bx, hit, one);
+			bvx = _mm512_mask_sub_ps(bvx, hit, zero, bvx);
+
+			hit = _mm512_cmp_ps_mask(bx, minus_one, _CMP_LE_OQ) & _mm512_cmp_ps_mask(bvx, zero, _CMP_LT_OQ);
+			bx = _mm512_mask_mov_ps(bx, hit, minus_one);
+			bvx = _mm512_mask_sub_ps(bvx, hit, zero, bvx);
+
+			hit = _mm512_cmp_ps_mask(by, one, _CMP_GE_OQ) & _mm512_cmp_ps_mask(bvy, zero, _CMP_GT_OQ);
+			by = _mm512_mask_mov_ps(by, hit, one);
+			bvy = _mm512_mask_sub_ps(bvy, hit, zero, bvy);
+
+			hit = _mm512_cmp_ps_mask(by, minus_one, _CMP_LE_OQ) & _mm512_cmp_ps_mask(bvy, zero, _CMP_LT_OQ);
+			by = _mm512_mask_mov_ps(by, hit, minus_one);
+			bvy = _mm512_mask_sub_ps(bvy, hit, zero, bvy);
+
+			_mm512_mask_storeu_ps(px, live, bx);
+			_mm512_mask_storeu_ps(py, live, by);
+			_mm512_mask_storeu_ps(pvx, live, bvx);
+			_mm512_mask_storeu_ps(pvy, live, bvy);
+		}
+	}
+}
+
+#endif
+
+// The kernel for a level from usable_simd_level()
+inline StepKernel select_step_kernel(SimdLevel level){
+	switch (level){
+#if SIMD_X86
+		case SimdLevel::Avx512:
+			return step_avx512;
+		case SimdLevel::Avx2:
+			return step_avx2;
+#endif
+		default:
+			return step_scalar;
+	}
+}
+
+#endif
@@ -5,12 +5,46 @@
 #include "../include/stb_image.h"
 #include <vector>
 #include <random>
-#include "simulation.cpp"
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <cstring>
+#include <cstdlib>
+#include "simulation.h"
+#include "triple_buffer.h"
+#include "governor.h"
+#include "stream_buffer.h"
+#include "profiler.h"
 
 const int PARTICLE_COUNT = 500;
 const int WINDOW_WIDTH = 800;
 const int WINDOW_HEIGHT = 600;
-const double FIXED_DT = 1.0f / 60.0f; //How often we do our physics updates
+/*
+ * How often we do our physics updates. Frames blend the last two ticks, so
+ * motion stays smooth at refresh rates well above this; big scenes can
+ * lower it to save simulation time.
+ */
+const double FIXED_DT = 1.0f / 60.0f;
+
+// How often a profiled run prints its per-phase summary, and the window it covers
+const double PROFILE_SUMMARY_SECONDS = 1.0;
+
+/*
+ * One finished tick as handed to the render thread, along with the tick
+ * before it and the time the tick stands for. A frame drawn at time t shows
+ * previous blended into positions by (t - time) / FIXED_DT, so the picture
+ * runs one tick behind the simulation and never has to guess ahead.
+ *
+ * Only positions are drawn, so only they are kept: x and y per particle in
+ * id order, quantised to 16 bits by Simulation::export_positions_by_id.
+ */
+struct Snapshot{
+	std::vector<int16_t> positions;
+	std::vector<int16_t> previous;
+	std::chrono::steady_clock::time_point time;
+	size_t tick = 0;
+};
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height){
 	glViewport(0, 0, width, height);
@@ -54,11 +88,29 @@ int main(){
 	// Build and compile our shader program
 	Shader ourShader("../src/vertex.glsl", "../src/fragment.glsl");
 
+	/*
+	 * DRETSIM_TRACE=file turns the profiler on: a p50 / p99 summary of
+	 * every phase each PROFILE_SUMMARY_SECONDS, and a Chrome trace of the
+	 * last events of each thread written to file on exit.
+	 */
+	const char *tracePath = std::getenv("DRETSIM_TRACE");
+	if (tracePath){
+		Profiler::set_thread_name("render");
+		Profiler::enable();
+	}
+
 	Simulation sim(PARTICLE_COUNT);
-	const std::vector<Particle> &particles = sim.get_particles();
-	size_t particleSize = sim.get_particle_size();
+	const size_t vertexSize = 2 * sizeof(int16_t);
 	size_t particlesCount = sim.get_particles_count();
-	const Particle *particlesData = sim.get_particles_data();
+
+	// Every slot starts out as the initial state, so the first frames have something to draw
+	TripleBuffer<Snapshot> snapshots;
+	Snapshot initial;
+	initial.positions.resize(2 * particlesCount);
+	sim.export_positions_by_id(initial.positions.data());
+	initial.previous = initial.positions;
+	initial.time = std::chrono::steady_clock::now();
+	snapshots.fill(initial);
 
 	/*
 	 * ===========================================================
@@ -66,52 +118,156 @@ int main(){
 	 * ===========================================================
 	 */
 
-	unsigned int VAO, VBO;
+	unsigned int VAO;
 
 	glGenVertexArrays(1, &VAO);
-	glGenBuffers(1, &VBO);
-
 	glBindVertexArray(VAO);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, particlesCount * particleSize, particlesData, GL_DYNAMIC_DRAW);
 
-	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, particleSize, (void *)0);
+	/*
+	 * Each region of the stream buffer holds the current positions, then
+	 * the previous tick's. Regions are a whole number of vertices apart, so
+	 * drawing from another region only moves the first vertex; the
+	 * attribute offsets stay as set here.
+	 */
+	const size_t stateBytes = particlesCount * vertexSize;
+	std::unique_ptr<StreamBuffer> vertices(new StreamBuffer(2 * stateBytes, (GLADloadproc)glfwGetProcAddress));
+	std::cout << (vertices->persistent() ? "Streaming through a persistent mapping\n" : "Streaming through buffer orphaning\n");
+
+	// Copy a snapshot into the next free region, and return the vertex it starts at
+	auto upload = [&](const Snapshot &snapshot){
+		char *region = static_cast<char *>(vertices->map_next());
+		std::memcpy(region, snapshot.positions.data(), stateBytes);
+		std::memcpy(region + stateBytes, snapshot.previous.data(), stateBytes);
+		return static_cast<GLint>(vertices->unmap() / vertexSize);
+	};
+	GLint firstVertex = upload(snapshots.read_buffer());
+
+	// Integer attributes: the shader does the decoding, the same way on every GL version
+	glVertexAttribIPointer(0, 2, GL_SHORT, vertexSize, (void *)0);
 	glEnableVertexAttribArray(0);
+	glVertexAttribIPointer(1, 2, GL_SHORT, vertexSize, (void *)stateBytes);
+	glEnableVertexAttribArray(1);
+
+	/*
+	 * ===========================================================
+	 * SIMULATION THREAD
+	 * ===========================================================
+	 *
+	 * The simulation runs on its own thread and publishes every finished
+	 * batch of ticks into the triple buffer. Neither side ever waits for
+	 * the other: a slow tick no longer holds up presenting, and vsync no
+	 * longer holds up the simulation. Only this thread touches sim from
+	 * here on.
+	 *
+	 * The governor caps how many ticks a batch may run to catch up, and
+	 * moves the simulation to cheaper settings while it cannot keep up.
+	 */
+
+	Governor governor(sim.get_settings(), FIXED_DT);
+	std::atomic<bool> running(true);
+	std::thread simThread([&]{
+		if (tracePath){
+			Profiler::set_thread_name("simulation");
+		}
+		using Clock = std::chrono::steady_clock;
+		const Clock::duration step = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(FIXED_DT));
+		Clock::time_point nextTick = Clock::now() + step;
 
-	double accumulator = 0.0f;
-	double lastTime = glfwGetTime();
+		while (running.load(std::memory_order_relaxed)){
+			// Simulation should happen 60 times per second regardless of the machine's frame rate
+			Clock::time_point now = Clock::now();
+			if (now < nextTick){
+				std::this_thread::sleep_until(nextTick);
+				continue;
+			}
 
-	while(!glfwWindowShouldClose(window)){
-		// Simulation should happen 60 times per second regardless of the machine's frame rate
-		double currentTime = glfwGetTime();
-		double frameTime = currentTime - lastTime;
-		lastTime = currentTime;
+			// Ticks past the governor's cap are skipped rather than run late
+			size_t due = 1 + static_cast<size_t>((now - nextTick) / step);
+			size_t ticks = governor.begin_batch(due);
+			nextTick += step * static_cast<Clock::rep>(due - ticks);
 
-		accumulator += frameTime;
+			// Frames blend the last two ticks, so keep the state before the final tick of the batch
+			Snapshot &snapshot = snapshots.write_buffer();
+			Clock::time_point batchStart = Clock::now();
+			{
+				ProfileScope scope("batch");
+				for (size_t k = 0; k < ticks; k++){
+					if (k + 1 == ticks){
+						sim.export_positions_by_id(snapshot.previous.data());
+					}
+					sim.update_particles(FIXED_DT);
+					nextTick += step;
+				}
+			}
 
+			std::chrono::duration<double> busy = Clock::now() - batchStart;
+			if (governor.end_batch(busy.count(), ticks)){
+				const GovernorLevel &level = governor.get_level();
+				sim.set_solver(level.solver);
+				sim.set_theta(level.theta);
+			}
+
+			{
+				ProfileScope scope("export");
+				sim.export_positions_by_id(snapshot.positions.data());
+			}
+			snapshot.time = nextTick - step;
+			snapshot.tick = sim.get_tick();
+			snapshots.publish();
+		}
+	});
+
+	std::chrono::steady_clock::time_point lastSummary = std::chrono::steady_clock::now();
+	while(!glfwWindowShouldClose(window)){
+		ProfileScope frameScope("frame");
 		processInput(window);
 
-		while (accumulator >= FIXED_DT){
-			sim.update_particles(FIXED_DT);
-			accumulator -= FIXED_DT;
+		// Upload only when the simulation has finished a tick since the last frame
+		if (snapshots.update()){
+			ProfileScope scope("upload");
+			firstVertex = upload(snapshots.read_buffer());
 		}
-		const Particle *particlesData = sim.get_particles_data();
 
-		glBindBuffer(GL_ARRAY_BUFFER, VBO);
-		glBufferSubData(GL_ARRAY_BUFFER, 0, particlesCount * particleSize, particlesData);
+		// How far this frame is from the previous tick to the current one
+		std::chrono::duration<double> sinceTick = std::chrono::steady_clock::now() - snapshots.read_buffer().time;
+		float alpha = static_cast<float>(std::min(std::max(sinceTick.count() / FIXED_DT, 0.0), 1.0));
 
 		glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT);
 
-		ourShader.use();
-		glBindVertexArray(VAO);
-		glDrawArrays(GL_POINTS, 0, particlesCount);
+		{
+			ProfileScope scope("draw");
+			ourShader.use();
+			ourShader.setFloat("alpha", alpha);
+			glBindVertexArray(VAO);
+			glDrawArrays(GL_POINTS, firstVertex, particlesCount);
+			vertices->fence();
+		}
 
 		// check for and call events and swap the buffers
-		glfwSwapBuffers(window);
-		glfwPollEvents();
+		{
+			ProfileScope scope("swap");
+			glfwSwapBuffers(window);
+			glfwPollEvents();
+		}
+
+		std::chrono::duration<double> sinceSummary = std::chrono::steady_clock::now() - lastSummary;
+		if (tracePath && sinceSummary.count() >= PROFILE_SUMMARY_SECONDS){
+			Profiler::print_summary(std::cout, PROFILE_SUMMARY_SECONDS * 1000.0);
+			lastSummary = std::chrono::steady_clock::now();
+		}
 	}
 
+	running.store(false, std::memory_order_relaxed);
+	simThread.join();
+
+	if (tracePath && !Profiler::write_trace(tracePath)){
+		std::cout << "Failed to write the trace to " << tracePath << "\n";
+	}
+
+	// GL objects go while the context is still alive
+	vertices.reset();
+
 	glfwTerminate();
 	return 0;
 }
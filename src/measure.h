@@ -0,0 +1,133 @@
+#ifndef MEASURE_H
+#define MEASURE_H
+
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+#include "simulation.h"
+
+/*
+ * Timing helpers shared by the measuring programs: repeated runs of a
+ * simulation, each phase timed through Simulation::get_phase_times(), and
+ * the spread of the repetitions.
+ */
+
+// min / median / max of the repetitions, and their standard deviation over the mean
+struct Spread{
+	double min = 0.0;
+	double median = 0.0;
+	double max = 0.0;
+	double rsd = 0.0;
+};
+
+inline Spread spread_of(std::vector<double> values){
+	Spread spread;
+	if (values.empty()){
+		return spread;
+	}
+	std::sort(values.begin(), values.end());
+	const size_t n = values.size();
+	spread.min = values.front();
+	spread.max = values.back();
+	spread.median = n % 2 ? values[n / 2] : 0.5 * (values[n / 2 - 1] + values[n / 2]);
+
+	double mean = 0.0;
+	for (double v : values){
+		mean += v;
+	}
+	mean /= n;
+	double variance = 0.0;
+	for (double v : values){
+		variance += (v - mean) * (v - mean);
+	}
+	variance /= n;
+	spread.rsd = mean > 0.0 ? std::sqrt(variance) / mean : 0.0;
+	return spread;
+}
+
+inline std::vector<double> scaled(std::vector<double> values, double factor){
+	for (double &v : values){
+		v *= factor;
+	}
+	return values;
+}
+
+/*
+ * Milliseconds per tick of each phase, one value per repetition. total is
+ * the wall time of the whole tick as seen from outside, so it also holds
+ * what falls between the phases.
+ */
+struct PhaseSamples{
+	long ticks = 0;		// per repetition
+	std::vector<double> reorder;
+	std::vector<double> long_range;
+	std::vector<double> short_range;
+	std::vector<double> step;
+	std::vector<double> total;
+
+	// Hardware counts over every timed repetition, when the simulation has them open
+	PhaseCounterTotals counters;
+};
+
+struct SampleSettings{
+	long warmup = 2;	// untimed ticks first
+	long reps = 5;
+	double min_time = 0.2;	// least seconds per repetition
+	long max_ticks = 1000;
+};
+
+/*
+ * Warms sim up, sizes the repetitions from how long a warm-up tick took so
+ * each lasts at least min_time, then times them. Resets the simulation's
+ * phase counters once warm.
+ */
+inline PhaseSamples sample_phases(Simulation &sim, float dt, const SampleSettings &settings){
+	PhaseSamples samples;
+
+	auto start = std::chrono::steady_clock::now();
+	for (long t = 0; t < settings.warmup; t++){
+		sim.update_particles(dt);
+	}
+	double tick_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	tick_seconds = settings.warmup > 0 ? tick_seconds / settings.warmup : 0.0;
+	samples.ticks = tick_seconds > 0.0 ? static_cast<long>(std::ceil(settings.min_time / tick_seconds)) : 1;
+	samples.ticks = std::min(std::max(samples.ticks, 1L), settings.max_ticks);
+	sim.reset_phase_counters();
+
+	for (long r = 0; r < settings.reps; r++){
+		PhaseTimes sum;
+		start = std::chrono::steady_clock::now();
+		for (long t = 0; t < samples.ticks; t++){
+			sim.update_particles(dt);
+			const PhaseTimes &times = sim.get_phase_times();
+			sum.reorder_ms += times.reorder_ms;
+			sum.long_range_ms += times.long_range_ms;
+			sum.short_range_ms += times.short_range_ms;
+			sum.step_ms += times.step_ms;
+		}
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+		samples.reorder.push_back(sum.reorder_ms / samples.ticks);
+		samples.long_range.push_back(sum.long_range_ms / samples.ticks);
+		samples.short_range.push_back(sum.short_range_ms / samples.ticks);
+		samples.step.push_back(sum.step_ms / samples.ticks);
+		samples.total.push_back(elapsed.count() / samples.ticks);
+	}
+	samples.counters = sim.get_phase_counters();
+	return samples;
+}
+
+// Keeps one core busy for a while so the clock is up before anything is timed
+inline void spin_up(double seconds){
+	auto start = std::chrono::steady_clock::now();
+	volatile double sink = 1.0;
+	while (std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() < seconds){
+		for (int i = 0; i < 100000; i++){
+			sink = sink * 1.0000001 + 1e-9;
+		}
+	}
+}
+
+#endif
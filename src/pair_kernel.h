@@ -0,0 +1,196 @@
+#ifndef PAIR_KERNEL_H
+#define PAIR_KERNEL_H
+
+#include <cstdint>
+#include <cmath>
+
+#include "simd_level.h"
+
+/*
+ * Pair force between particle i and particle j at offset (dx, dy) = j - i,
+ * with d^2 = dx^2 + dy^2:
+ *
+ *   strength = d^2 < limit_sqr ? near_strength : far_strength
+ *   force    = strength / d^2 along (dx, dy), zero when d^2 <= min_sqr
+ *   minus inner * (dx, dy) when d^2 < limit_sqr
+ *
+ * With near = REP, far = ATTR and inner = 0 this is the whole original pair
+ * force; with far = 0 it is the short-range correction on top of a
+ * long-range solver.
+ */
+struct PairParams{
+	float near_strength;
+	float far_strength;
+	float limit_sqr;
+	float min_sqr;
+	float inner;
+};
+
+/*
+ * Accumulates the force between i and every j in [begin, end) into ax / ay:
+ * +f on i and -f on each j. x, y, ax and ay are plain contiguous arrays and
+ * i must lie outside [begin, end).
+ */
+using PairRowKernel = void (*)(const float *x, const float *y, float *ax, float *ay,
+		uint32_t i, uint32_t begin, uint32_t end, const PairParams &params);
+
+inline void pair_row_scalar(const float *x, const float *y, float *ax, float *ay,
+		uint32_t i, uint32_t begin, uint32_t end, const PairParams &params){
+
+	const float xi = x[i];
+	const float yi = y[i];
+	float sum_x = 0.0f;
+	float sum_y = 0.0f;
+
+	for (uint32_t j = begin; j < end; j++){
+		float dist_x = x[j] - xi;
+		float dist_y = y[j] - yi;
+		float dist_sqr = (dist_x * dist_x) + (dist_y * dist_y);
+
+		bool near = dist_sqr < params.limit_sqr;
+		float scale = near ? -params.inner : 0.0f;
+		if (dist_sqr > params.min_sqr){ // avoid division by 0
+			float strength = near ? params.near_strength : params.far_strength;
+			scale += strength / (dist_sqr * std::sqrt(dist_sqr));
+		}
+
+		float fx = dist_x * scale;
+		float fy = dist_y * scale;
+		sum_x += fx;
+		sum_y += fy;
+		ax[j] -= fx;
+		ay[j] -= fy;
+	}
+
+	ax[i] += sum_x;
+	ay[i] += sum_y;
+}
+
+#if SIMD_X86
+
+/*
+ * The vector kernels compute the same expression 8 or 16 j at a time. The
+ * branches become masks: a compare picks the strength, and lanes inside
+ * min_sqr or past end are zeroed after the division, so whatever the
+ * division produced there never reaches the sums. The last partial vector
+ * uses masked loads and stores rather than a scalar tail.
+ *
+ * Each kernel is compiled for its own instruction set through the target
+ * attribute, so the rest of the program needs no -m flags and the binary
+ * still runs on CPUs without AVX2.
+ */
+__attribute__((target("avx2,fma")))
+inline void pair_row_avx2(const float *x, const float *y, float *ax, float *ay,
+		uint32_t i, uint32_t begin, uint32_t end, const PairParams &params){
+
+	const __m256 xi = _mm256_set1_ps(x[i]);
+	const __m256 yi = _mm256_set1_ps(y[i]);
+	const __m256 near_strength = _mm256_set1_ps(params.near_strength);
+	const __m256 far_strength = _mm256_set1_ps(params.far_strength);
+	const __m256 limit_sqr = _mm256_set1_ps(params.limit_sqr);
+	const __m256 min_sqr = _mm256_set1_ps(params.min_sqr);
+	const __m256 inner = _mm256_set1_ps(params.inner);
+	const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+	__m256 sum_x = _mm256_setzero_ps();
+	__m256 sum_y = _mm256_setzero_ps();
+
+	for (uint32_t j = begin; j < end; j += 8){
+		__m256i live = _mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(end - j)), lane);
+
+		__m256 dist_x = _mm256_sub_ps(_mm256_maskload_ps(x + j, live), xi);
+		__m256 dist_y = _mm256_sub_ps(_mm256_maskload_ps(y + j, live), yi);
+		__m256 dist_sqr = _mm256_fmadd_ps(dist_x, dist_x, _mm256_mul_ps(dist_y, dist_y));
+
+		__m256 near = _mm256_cmp_ps(dist_sqr, limit_sqr, _CMP_LT_OQ);
+		__m256 apart = _mm256_and_ps(_mm256_cmp_ps(dist_sqr, min_sqr, _CMP_GT_OQ), _mm256_castsi256_ps(live));
+
+		__m256 strength = _mm256_blendv_ps(far_strength, near_strength, near);
+		__m256 force = _mm256_div_ps(strength, _mm256_mul_ps(dist_sqr, _mm256_sqrt_ps(dist_sqr)));
+		__m256 scale = _mm256_sub_ps(_mm256_and_ps(force, apart),
+				_mm256_and_ps(inner, _mm256_and_ps(near, _mm256_castsi256_ps(live))));
+
+		__m256 fx = _mm256_mul_ps(dist_x, scale);
+		__m256 fy = _mm256_mul_ps(dist_y, scale);
+		sum_x = _mm256_add_ps(sum_x, fx);
+		sum_y = _mm256_add_ps(sum_y, fy);
+
+		_mm256_maskstore_ps(ax + j, live, _mm256_sub_ps(_mm256_maskload_ps(ax + j, live), fx));
+		_mm256_maskstore_ps(ay + j, live, _mm256_sub_ps(_mm256_maskload_ps(ay + j, live), fy));
+	}
+
+	alignas(32) float lanes_x[8];
+	alignas(32) float lanes_y[8];
+	_mm256_store_ps(lanes_x, sum_x);
+	_mm256_store_ps(lanes_y, sum_y);
+	for (int k = 0; k < 8; k++){
+		ax[i] += lanes_x[k];
+		ay[i] += lanes_y[k];
+	}
+}
+
+__attribute__((target("avx512f")))
+inline void pair_row_avx512(const float *x, const float *y, float *ax, float *ay,
+		uint32_t i, uint32_t begin, uint32_t end, const PairParams &params){
+
+	const __m512 xi = _mm512_set1_ps(x[i]);
+	const __m512 yi = _mm512_set1_ps(y[i]);
+	const __m512 near_strength = _mm512_set1_ps(params.near_strength);
+	const __m512 far_strength = _mm512_set1_ps(params.far_strength);
+	const __m512 limit_sqr = _mm512_set1_ps(params.limit_sqr);
+	const __m512 min_sqr = _mm512_set1_ps(params.min_sqr);
+	const __m512 neg_inner = _mm512_set1_ps(-params.inner);
+
+	__m512 sum_x = _mm512_setzero_ps();
+	__m512 sum_y = _mm512_setzero_ps();
+
+	for (uint32_t j = begin; j < end; j += 16){
+		__mmask16 live = end - j >= 16 ? __mmask16(0xffff) : __mmask16((1u << (end - j)) - 1);
+
+		__m512 dist_x = _mm512_sub_ps(_mm512_maskz_loadu_ps(live, x + j), xi);
+		__m512 dist_y = _mm512_sub_ps(_mm512_maskz_loadu_ps(live, y + j), yi);
+		__m512 dist_sqr = _mm512_fmadd_ps(dist_x, dist_x, _mm512_mul_ps(dist_y, dist_y));
+
+		__mmask16 near = _mm512_mask_cmp_ps_mask(live, dist_sqr, limit_sqr, _CMP_LT_OQ);
+		__mmask16 apart = _mm512_mask_cmp_ps_mask(live, dist_sqr, min_sqr, _CMP_GT_OQ);
+
+		__m512 strength = _mm512_mask_blend_ps(near, far_strength, near_strength);
+		__m512 force = _mm512_maskz_div_ps(apart, strength, _mm512_mul_ps(dist_sqr, _mm512_maskz_sqrt_ps(apart, dist_sqr)));
+		__m512 scale = _mm512_mask_add_ps(force, near, force, neg_inner);
+
+		__m512 fx = _mm512_mul_ps(dist_x, scale);
+		__m512 fy = _mm512_mul_ps(dist_y, scale);
+		sum_x = _mm512_add_ps(sum_x, fx);
+		sum_y = _mm512_add_ps(sum_y, fy);
+
+		_mm512_mask_storeu_ps(ax + j, live, _mm512_sub_ps(_mm512_maskz_loadu_ps(live, ax + j), fx));
+		_mm512_mask_storeu_ps(ay + j, live, _mm512_sub_ps(_mm512_maskz_loadu_ps(live, ay + j), fy));
+	}
+
+	alignas(64) float lanes_x[16];
+	alignas(64) float lanes_y[16];
+	_mm512_store_ps(lanes_x, sum_x);
+	_mm512_store_ps(lanes_y, sum_y);
+	for (int k = 0; k < 16; k++){
+		ax[i] += lanes_x[k];
+		ay[i] += lanes_y[k];
+	}
+}
+
+#endif
+
+// The kernel for a level from usable_simd_level()
+inline PairRowKernel select_pair_kernel(SimdLevel level){
+	switch (level){
+#if SIMD_X86
+		case SimdLevel::Avx512:
+			return pair_row_avx512;
+		case SimdLevel::Avx2:
+			return pair_row_avx2;
+#endif
+		default:
+			return pair_row_scalar;
+	}
+}
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef PARTICLE_H
+#define PARTICLE_H
+
+struct Particle{
+	float x, y;
+	float vx, vy;
+};
+
+#endif
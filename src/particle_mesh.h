@@ -0,0 +1,300 @@
+#ifndef PARTICLE_MESH_H
+#define PARTICLE_MESH_H
+
+#include <vector>
+#include <complex>
+#include <cmath>
+#include <algorithm>
+
+#include "particle_store.h"
+#include "fft.h"
+#include "thread_pool.h"
+
+/*
+ * Particle-mesh solver for the inverse-square attraction.
+ *
+ * Particles are deposited onto a fixed mesh over the simulation box with
+ * cloud-in-cell weights, the potential is found by convolving with a Green's
+ * function through the FFT, and the mesh gradient is interpolated back with
+ * the same weights. The mesh is zero-padded to twice its size so the
+ * convolution is isolated rather than periodic.
+ *
+ * The mesh can only resolve the smooth part of the force, so the 1 / r
+ * potential is split at the cutoff a with a uniform sphere shape (S1 in
+ * Hockney & Eastwood):
+ *
+ *   phi_long(r) = (3 a^2 - r^2) / (2 a^3)   for r < a
+ *               = 1 / r                     for r >= a
+ *
+ * The mesh carries phi_long. Its pair force is r / a^3 inside the cutoff
+ * and exactly 1 / r^2 outside, so the remainder is confined to pairs closer
+ * than a. The caller adds it back for those pairs through
+ * inner_force_over_dist(), P3M style.
+ */
+class ParticleMesh{
+
+	public:
+		ParticleMesh(float strength, float cutoff, int mesh_size):
+			strength(strength),
+			cutoff(cutoff),
+			inv_cutoff_cube(1.0f / (cutoff * cutoff * cutoff))
+		{
+			set_mesh_size(mesh_size);
+		}
+
+		// Mesh cells per side, rounded up to a power of two
+		void set_mesh_size(int new_size){
+			int size = 8;
+			while (size < new_size){
+				size <<= 1;
+			}
+			if (size != mesh_size){
+				mesh_size = size;
+				prepared = false;
+			}
+		}
+
+		int get_mesh_size() const{
+			return mesh_size;
+		}
+
+		/*
+		 * Mesh acceleration on every particle. With a pool, the transforms,
+		 * gradient and interpolation split over rows, columns or particles;
+		 * the deposit scatters into shared cells and stays on the caller.
+		 */
+		void accelerations(const ParticleStore &particles, std::vector<float> &ax, std::vector<float> &ay,
+				ThreadPool *pool = nullptr){
+			prepare();
+
+			deposit(particles);
+			solve(pool);
+			gradient(pool);
+			interpolate(particles, ax, ay, pool);
+		}
+
+		/*
+		 * Mesh pair force inside the cutoff divided by distance, without the
+		 * strength: 1 / a^3. The caller scales the separation vector by it.
+		 */
+		float inner_force_over_dist() const{
+			return inv_cutoff_cube;
+		}
+
+	private:
+		using Complex = Fft::Complex;
+
+		/*
+		 * ======================================
+		 * SETUP
+		 * ======================================
+		 */
+
+		void prepare(){
+			if (prepared){
+				return;
+			}
+			prepared = true;
+
+			const int padded = 2 * mesh_size;
+			spacing = 2.0 * BOX_HALF_WIDTH / mesh_size;
+
+			fft.resize(padded);
+			work.assign(size_t(padded) * padded, Complex(0.0f));
+			potential.assign(size_t(mesh_size) * mesh_size, 0.0f);
+			grad_x.assign(size_t(mesh_size) * mesh_size, 0.0f);
+			grad_y.assign(size_t(mesh_size) * mesh_size, 0.0f);
+
+			// Green's function on the padded mesh, wrapped so negative offsets sit at the end
+			green_hat.assign(size_t(padded) * padded, Complex(0.0f));
+			for (int j = 0; j < padded; j++){
+				int dy = j < mesh_size ? j : j - padded;
+				for (int i = 0; i < padded; i++){
+					int dx = i < mesh_size ? i : i - padded;
+					double r = spacing * std::sqrt(static_cast<double>(dx * dx + dy * dy));
+					green_hat[size_t(j) * padded + i] = Complex(static_cast<float>(long_range_potential(r)), 0.0f);
+				}
+			}
+			transform_2d(green_hat.data(), padded, false, nullptr);
+
+			// Fold the inverse transform's 1 / n^2 into the kernel
+			const float normalise = 1.0f / (static_cast<float>(padded) * padded);
+			for (Complex &g : green_hat){
+				g *= normalise;
+			}
+		}
+
+		double long_range_potential(double r) const{
+			if (r < cutoff){
+				return (3.0 * cutoff * cutoff - r * r) / (2.0 * cutoff * cutoff * cutoff);
+			}
+			return 1.0 / r;
+		}
+
+		// Rows, then columns through a scratch copy
+		void transform_2d(Complex *data, int padded, bool inverse, ThreadPool *pool){
+			transform_rows(data, padded, padded, inverse, pool);
+			transform_columns(data, padded, inverse, pool);
+		}
+
+		void transform_rows(Complex *data, int rows, int padded, bool inverse, ThreadPool *pool){
+			parallel_for(pool, 0, rows, FFT_GRAIN, [&](size_t begin, size_t end){
+				for (size_t j = begin; j < end; j++){
+					fft.transform(data + j * padded, inverse);
+				}
+			});
+		}
+
+		void transform_columns(Complex *data, int padded, bool inverse, ThreadPool *pool){
+			parallel_for(pool, 0, padded, FFT_GRAIN, [&](size_t begin, size_t end){
+				std::vector<Complex> column(padded);
+				for (size_t i = begin; i < end; i++){
+					for (int j = 0; j < padded; j++){
+						column[j] = data[size_t(j) * padded + i];
+					}
+					fft.transform(column.data(), inverse);
+					for (int j = 0; j < padded; j++){
+						data[size_t(j) * padded + i] = column[j];
+					}
+				}
+			});
+		}
+
+		/*
+		 * ======================================
+		 * PER TICK
+		 * ======================================
+		 */
+
+		/*
+		 * Cloud-in-cell weights for a coordinate: mesh nodes sit at cell
+		 * centres, and anything past the outer nodes is clamped onto them.
+		 */
+		void cic(float v, int &index, float &frac) const{
+			float t = static_cast<float>((v + BOX_HALF_WIDTH) / spacing) - 0.5f;
+			t = std::min(std::max(t, 0.0f), static_cast<float>(mesh_size - 1));
+			index = std::min(static_cast<int>(t), mesh_size - 2);
+			frac = t - index;
+		}
+
+		void deposit(const ParticleStore &particles){
+			const int padded = 2 * mesh_size;
+			ParticleStore::ConstColumn x = particles.x();
+			ParticleStore::ConstColumn y = particles.y();
+			std::fill(work.begin(), work.end(), Complex(0.0f));
+
+			for (size_t p = 0; p < particles.size(); p++){
+				int ix, iy;
+				float fx, fy;
+				cic(x[p], ix, fx);
+				cic(y[p], iy, fy);
+
+				Complex *row = &work[size_t(iy) * padded + ix];
+				row[0] += (1.0f - fx) * (1.0f - fy);
+				row[1] += fx * (1.0f - fy);
+				row[padded] += (1.0f - fx) * fy;
+				row[padded + 1] += fx * fy;
+			}
+		}
+
+		/*
+		 * Only the first mesh_size rows hold mass, and only they are read
+		 * back, so the row transforms skip the padding rows both ways.
+		 */
+		void solve(ThreadPool *pool){
+			const int padded = 2 * mesh_size;
+
+			transform_rows(work.data(), mesh_size, padded, false, pool);
+			transform_columns(work.data(), padded, false, pool);
+
+			parallel_for(pool, 0, work.size(), size_t(FFT_GRAIN) * padded, [&](size_t begin, size_t end){
+				for (size_t k = begin; k < end; k++){
+					const Complex a = work[k];
+					const Complex g = green_hat[k];
+					work[k] = Complex(a.real() * g.real() - a.imag() * g.imag(),
+							a.real() * g.imag() + a.imag() * g.real());
+				}
+			});
+
+			transform_columns(work.data(), padded, true, pool);
+			parallel_for(pool, 0, mesh_size, FFT_GRAIN, [&](size_t begin, size_t end){
+				for (size_t j = begin; j < end; j++){
+					fft.transform(&work[j * padded], true);
+					for (int i = 0; i < mesh_size; i++){
+						potential[j * mesh_size + i] = work[j * padded + i].real();
+					}
+				}
+			});
+		}
+
+		// Central differences, one-sided on the mesh edge
+		void gradient(ThreadPool *pool){
+			const float inv_h = static_cast<float>(1.0 / spacing);
+			const int last = mesh_size - 1;
+
+			parallel_for(pool, 0, mesh_size, FFT_GRAIN, [&](size_t begin, size_t end){
+				for (int j = int(begin); j < int(end); j++){
+					int down = std::max(j - 1, 0), up = std::min(j + 1, last);
+					for (int i = 0; i < mesh_size; i++){
+						int left = std::max(i - 1, 0), right = std::min(i + 1, last);
+
+						float dx = potential[size_t(j) * mesh_size + right] - potential[size_t(j) * mesh_size + left];
+						float dy = potential[size_t(up) * mesh_size + i] - potential[size_t(down) * mesh_size + i];
+						grad_x[size_t(j) * mesh_size + i] = dx * inv_h / (right - left);
+						grad_y[size_t(j) * mesh_size + i] = dy * inv_h / (up - down);
+					}
+				}
+			});
+		}
+
+		// phi_long falls off with distance, so +grad(phi) points at the mass
+		void interpolate(const ParticleStore &particles, std::vector<float> &ax, std::vector<float> &ay,
+				ThreadPool *pool) const{
+			ParticleStore::ConstColumn x = particles.x();
+			ParticleStore::ConstColumn y = particles.y();
+			ax.resize(particles.size());
+			ay.resize(particles.size());
+
+			parallel_for(pool, 0, particles.size(), PARTICLE_GRAIN, [&](size_t begin, size_t end){
+				for (size_t p = begin; p < end; p++){
+					int ix, iy;
+					float fx, fy;
+					cic(x[p], ix, fx);
+					cic(y[p], iy, fy);
+
+					size_t k = size_t(iy) * mesh_size + ix;
+					float w00 = (1.0f - fx) * (1.0f - fy), w10 = fx * (1.0f - fy);
+					float w01 = (1.0f - fx) * fy, w11 = fx * fy;
+
+					ax[p] = strength * (w00 * grad_x[k] + w10 * grad_x[k + 1]
+							+ w01 * grad_x[k + mesh_size] + w11 * grad_x[k + mesh_size + 1]);
+					ay[p] = strength * (w00 * grad_y[k] + w10 * grad_y[k + 1]
+							+ w01 * grad_y[k + mesh_size] + w11 * grad_y[k + mesh_size + 1]);
+				}
+			});
+		}
+
+		// The box is [-1, 1]^2; the margin covers particles the wall bounce has not caught yet
+		static constexpr double BOX_HALF_WIDTH = 1.0625;
+
+		// Mesh rows or columns per task, and particles per task when interpolating
+		static const int FFT_GRAIN = 8;
+		static const size_t PARTICLE_GRAIN = 4096;
+
+		float strength;
+		double cutoff;
+		float inv_cutoff_cube;
+		int mesh_size = 0;
+		bool prepared = false;
+
+		double spacing;
+
+		Fft fft;
+		std::vector<Complex> green_hat;
+		std::vector<Complex> work;
+		std::vector<float> potential;
+		std::vector<float> grad_x;
+		std::vector<float> grad_y;
+};
+
+#endif
@@ -0,0 +1,291 @@
+#ifndef PARTICLE_STORE_H
+#define PARTICLE_STORE_H
+
+#include <vector>
+#include <new>
+#include <cstddef>
+#include <algorithm>
+
+#include "particle.h"
+
+// std::allocator that hands out memory on an Alignment-byte boundary
+template <typename T, size_t Alignment>
+struct AlignedAllocator{
+	using value_type = T;
+
+	template <typename U>
+	struct rebind{
+		using other = AlignedAllocator<U, Alignment>;
+	};
+
+	AlignedAllocator() = default;
+
+	template <typename U>
+	AlignedAllocator(const AlignedAllocator<U, Alignment> &){}
+
+	T *allocate(size_t n){
+		return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+	}
+
+	void deallocate(T *p, size_t){
+		::operator delete(p, std::align_val_t(Alignment));
+	}
+
+	template <typename U>
+	bool operator==(const AlignedAllocator<U, Alignment> &) const{
+		return true;
+	}
+
+	template <typename U>
+	bool operator!=(const AlignedAllocator<U, Alignment> &) const{
+		return false;
+	}
+};
+
+/*
+ * Structure-of-arrays particle storage.
+ *
+ * x, y, vx and vy live in separate arrays that start on a cache line, so a
+ * loop over one component reads contiguous, aligned memory. Each array is
+ * padded with zeros up to a whole number of cache lines, so vector code may
+ * run full-width over the tail without a scalar remainder loop.
+ */
+class SoaParticleStore{
+
+	public:
+		static const size_t ALIGNMENT = 64;
+		static const size_t PADDING = ALIGNMENT / sizeof(float);
+
+		// Particles per block in the block_*() views, and floats from one block to the next
+		static const size_t BLOCK_WIDTH = PADDING;
+		static const size_t BLOCK_STRIDE = BLOCK_WIDTH;
+
+		using Array = std::vector<float, AlignedAllocator<float, ALIGNMENT>>;
+		using Column = float *;
+		using ConstColumn = const float *;
+
+		SoaParticleStore(size_t count = 0){
+			resize(count);
+		}
+
+		void resize(size_t new_count){
+			count = new_count;
+			size_t padded = (count + PADDING - 1) / PADDING * PADDING;
+			xs.assign(padded, 0.0f);
+			ys.assign(padded, 0.0f);
+			vxs.assign(padded, 0.0f);
+			vys.assign(padded, 0.0f);
+		}
+
+		size_t size() const{
+			return count;
+		}
+
+		// Size including the zero padding at the end of each array
+		size_t padded_size() const{
+			return xs.size();
+		}
+
+		Column x(){ return xs.data(); }
+		Column y(){ return ys.data(); }
+		Column vx(){ return vxs.data(); }
+		Column vy(){ return vys.data(); }
+
+		ConstColumn x() const{ return xs.data(); }
+		ConstColumn y() const{ return ys.data(); }
+		ConstColumn vx() const{ return vxs.data(); }
+		ConstColumn vy() const{ return vys.data(); }
+
+		/*
+		 * The same storage as padded_size() / BLOCK_WIDTH blocks of
+		 * BLOCK_WIDTH contiguous floats per component, so loops written
+		 * block by block work unchanged on either layout.
+		 */
+		size_t block_count() const{
+			return xs.size() / BLOCK_WIDTH;
+		}
+
+		float *block_x(size_t b){ return xs.data() + b * BLOCK_WIDTH; }
+		float *block_y(size_t b){ return ys.data() + b * BLOCK_WIDTH; }
+		float *block_vx(size_t b){ return vxs.data() + b * BLOCK_WIDTH; }
+		float *block_vy(size_t b){ return vys.data() + b * BLOCK_WIDTH; }
+
+		Particle get(size_t i) const{
+			return Particle{xs[i], ys[i], vxs[i], vys[i]};
+		}
+
+		void set(size_t i, const Particle &p){
+			xs[i] = p.x;
+			ys[i] = p.y;
+			vxs[i] = p.vx;
+			vys[i] = p.vy;
+		}
+
+		// Interleave into the array-of-structs layout the renderer uploads
+		void export_particles(Particle *out) const{
+			for (size_t i = 0; i < count; i++){
+				out[i] = get(i);
+			}
+		}
+
+		void swap(SoaParticleStore &other){
+			std::swap(count, other.count);
+			xs.swap(other.xs);
+			ys.swap(other.ys);
+			vxs.swap(other.vxs);
+			vys.swap(other.vys);
+		}
+
+	private:
+		size_t count = 0;
+		Array xs;
+		Array ys;
+		Array vxs;
+		Array vys;
+};
+
+/*
+ * One component of an array-of-structures-of-arrays store, indexed by
+ * particle. Particle i is lane i % Width of block i / Width, and a block
+ * holds COMPONENTS runs of Width floats, so its component sits at
+ *
+ *   (i / Width) * COMPONENTS * Width + component * Width + i % Width
+ *
+ * which is base + i + (COMPONENTS - 1) * (i & ~(Width - 1)) once base points
+ * at the component's run in block 0.
+ */
+template <typename T, size_t Width, size_t COMPONENTS>
+class BlockColumn{
+
+	public:
+		BlockColumn(T *base): base(base){}
+
+		// A writable column converts to a read-only one, like float * to const float *
+		template <typename U>
+		BlockColumn(const BlockColumn<U, Width, COMPONENTS> &other): base(other.data()){}
+
+		T *data() const{
+			return base;
+		}
+
+		T &operator[](size_t i) const{
+			return base[i + (COMPONENTS - 1) * (i & ~(Width - 1))];
+		}
+
+	private:
+		T *base;
+};
+
+/*
+ * Array-of-structures-of-arrays particle storage.
+ *
+ * Particles are grouped in blocks of Width. Inside a block each component is
+ * Width contiguous floats, so a block is as friendly to vector code as the
+ * SoA arrays, but one particle's position and velocity stay within a few
+ * cache lines instead of four separate streams. That helps the grid and tree
+ * walks, which touch particles out of storage order. With Width = 8 a block
+ * is two cache lines: positions in the first, velocities in the second.
+ *
+ * Indexed access goes through BlockColumn, which costs a shift and an add
+ * per lookup; loops that can go block by block should use the block_*()
+ * views instead.
+ */
+template <size_t Width>
+class AosoaParticleStore{
+
+	static_assert(Width > 0 && (Width & (Width - 1)) == 0, "block width must be a power of two");
+
+	public:
+		static const size_t ALIGNMENT = 64;
+		static const size_t COMPONENTS = 4;
+		static const size_t BLOCK_WIDTH = Width;
+		static const size_t BLOCK_FLOATS = COMPONENTS * Width;
+		static const size_t BLOCK_STRIDE = BLOCK_FLOATS;
+
+		using Array = std::vector<float, AlignedAllocator<float, ALIGNMENT>>;
+		using Column = BlockColumn<float, Width, COMPONENTS>;
+		using ConstColumn = BlockColumn<const float, Width, COMPONENTS>;
+
+		AosoaParticleStore(size_t count = 0){
+			resize(count);
+		}
+
+		void resize(size_t new_count){
+			count = new_count;
+			data.assign((count + Width - 1) / Width * BLOCK_FLOATS, 0.0f);
+		}
+
+		size_t size() const{
+			return count;
+		}
+
+		// Particle slots including the zero padding in the last block
+		size_t padded_size() const{
+			return block_count() * Width;
+		}
+
+		Column x(){ return Column(data.data()); }
+		Column y(){ return Column(data.data() + Width); }
+		Column vx(){ return Column(data.data() + 2 * Width); }
+		Column vy(){ return Column(data.data() + 3 * Width); }
+
+		ConstColumn x() const{ return ConstColumn(data.data()); }
+		ConstColumn y() const{ return ConstColumn(data.data() + Width); }
+		ConstColumn vx() const{ return ConstColumn(data.data() + 2 * Width); }
+		ConstColumn vy() const{ return ConstColumn(data.data() + 3 * Width); }
+
+		size_t block_count() const{
+			return data.size() / BLOCK_FLOATS;
+		}
+
+		float *block_x(size_t b){ return data.data() + b * BLOCK_FLOATS; }
+		float *block_y(size_t b){ return data.data() + b * BLOCK_FLOATS + Width; }
+		float *block_vx(size_t b){ return data.data() + b * BLOCK_FLOATS + 2 * Width; }
+		float *block_vy(size_t b){ return data.data() + b * BLOCK_FLOATS + 3 * Width; }
+
+		Particle get(size_t i) const{
+			const float *block = data.data() + (i / Width) * BLOCK_FLOATS + i % Width;
+			return Particle{block[0], block[Width], block[2 * Width], block[3 * Width]};
+		}
+
+		void set(size_t i, const Particle &p){
+			float *block = data.data() + (i / Width) * BLOCK_FLOATS + i % Width;
+			block[0] = p.x;
+			block[Width] = p.y;
+			block[2 * Width] = p.vx;
+			block[3 * Width] = p.vy;
+		}
+
+		// Interleave into the array-of-structs layout the renderer uploads
+		void export_particles(Particle *out) const{
+			for (size_t i = 0; i < count; i++){
+				out[i] = get(i);
+			}
+		}
+
+		void swap(AosoaParticleStore &other){
+			std::swap(count, other.count);
+			data.swap(other.data);
+		}
+
+	private:
+		size_t count = 0;
+		Array data;
+};
+
+/*
+ * The layout Simulation and the solvers are built against. Set
+ * DRETSIM_AOSOA_WIDTH to 8 or 16 (the DRETSIM_PARTICLE_LAYOUT CMake option
+ * does this) to switch from plain SoA to AoSoA blocks of that width.
+ */
+#ifndef DRETSIM_AOSOA_WIDTH
+#define DRETSIM_AOSOA_WIDTH 0
+#endif
+
+#if DRETSIM_AOSOA_WIDTH > 0
+using ParticleStore = AosoaParticleStore<DRETSIM_AOSOA_WIDTH>;
+#else
+using ParticleStore = SoaParticleStore;
+#endif
+
+#endif
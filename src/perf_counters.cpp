@@ -0,0 +1,130 @@
+#include "perf_counters.h"
+
+#if DRETSIM_PERF_COUNTERS
+
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+// Type and config of each counter, in the order of PhaseCounters
+static const uint32_t EVENT_TYPES[PerfCounters::EVENTS] = {
+	PERF_TYPE_HARDWARE,
+	PERF_TYPE_HARDWARE,
+	PERF_TYPE_HW_CACHE,
+	PERF_TYPE_HARDWARE,
+	PERF_TYPE_HARDWARE
+};
+
+static const uint64_t EVENT_CONFIGS[PerfCounters::EVENTS] = {
+	PERF_COUNT_HW_CPU_CYCLES,
+	PERF_COUNT_HW_INSTRUCTIONS,
+	PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+	PERF_COUNT_HW_CACHE_MISSES,
+	PERF_COUNT_HW_BRANCH_MISSES
+};
+
+static const char *EVENT_NAMES[PerfCounters::EVENTS] = {
+	"cycles", "instructions", "L1d read misses", "LLC misses", "branch misses"
+};
+
+PerfCounters::PerfCounters(bool enable){
+	if (!enable){
+		failure = "not enabled";
+		return;
+	}
+
+	/*
+	 * Each counter stands alone rather than in a group, since inherited
+	 * counters cannot be read as a group on older kernels. A read then
+	 * sums the opening thread and its live children.
+	 */
+	for (int e = 0; e < EVENTS; e++){
+		perf_event_attr attr;
+		std::memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = EVENT_TYPES[e];
+		attr.config = EVENT_CONFIGS[e];
+		attr.inherit = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+		fds[e] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+		if (fds[e] < 0){
+			failure = std::string("perf_event_open for ") + EVENT_NAMES[e] + ": " + std::strerror(errno);
+			for (int k = 0; k <= e; k++){
+				if (fds[k] >= 0){
+					close(fds[k]);
+				}
+				fds[k] = -1;
+			}
+			return;
+		}
+	}
+	mark();
+}
+
+PerfCounters::~PerfCounters(){
+	for (int fd : fds){
+		if (fd >= 0){
+			close(fd);
+		}
+	}
+}
+
+bool PerfCounters::read(uint64_t values[EVENTS]){
+	for (int e = 0; e < EVENTS; e++){
+		// value, time enabled, time running
+		uint64_t data[3] = {};
+		if (::read(fds[e], data, sizeof(data)) != ssize_t(sizeof(data))){
+			return false;
+		}
+		values[e] = data[2] > 0 && data[2] < data[1] ? uint64_t(double(data[0]) * double(data[1]) / double(data[2])) : data[0];
+	}
+	return true;
+}
+
+#else
+
+PerfCounters::PerfCounters(bool enable){
+	failure = enable ? "built without DRETSIM_PERF_COUNTERS" : "not enabled";
+}
+
+PerfCounters::~PerfCounters(){
+}
+
+bool PerfCounters::read(uint64_t *){
+	return false;
+}
+
+#endif
+
+void PerfCounters::mark(){
+	if (is_open()){
+		read(last);
+	}
+}
+
+void PerfCounters::accumulate(PhaseCounters &into){
+	uint64_t now[EVENTS];
+	if (!is_open() || !read(now)){
+		return;
+	}
+
+	// Scaled counts are estimates while multiplexed, and can step back slightly
+	uint64_t delta[EVENTS];
+	for (int e = 0; e < EVENTS; e++){
+		delta[e] = now[e] > last[e] ? now[e] - last[e] : 0;
+	}
+	into.cycles += delta[0];
+	into.instructions += delta[1];
+	into.l1d_misses += delta[2];
+	into.llc_misses += delta[3];
+	into.branch_misses += delta[4];
+	for (int e = 0; e < EVENTS; e++){
+		last[e] = now[e];
+	}
+}
@@ -0,0 +1,67 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <string>
+#include <cstdint>
+
+// Hardware event counts over some stretch of work, user space only
+struct PhaseCounters{
+	uint64_t cycles = 0;
+	uint64_t instructions = 0;
+	uint64_t l1d_misses = 0;	// L1 data cache read misses
+	uint64_t llc_misses = 0;	// last-level cache misses
+	uint64_t branch_misses = 0;
+
+	double ipc() const{
+		return cycles > 0 ? double(instructions) / double(cycles) : 0.0;
+	}
+};
+
+/*
+ * Hardware counters through Linux perf_event_open, for telling whether a
+ * layout or ordering change really saves cache misses.
+ *
+ * The counters follow the thread that opens them and every thread it
+ * starts afterwards, so they have to be opened before a ThreadPool spawns
+ * its workers for the pool's work to be counted. Counts are user space
+ * only, which perf_event_paranoid up to 2 allows, and are scaled up when
+ * the kernel had to multiplex them.
+ *
+ * Only built in with the DRETSIM_PERF_COUNTERS CMake option. Otherwise,
+ * or when the kernel refuses, every counter stays closed, the counts stay
+ * zero and error() says why.
+ */
+class PerfCounters{
+
+	public:
+		static const int EVENTS = 5;
+
+		explicit PerfCounters(bool enable);
+		~PerfCounters();
+
+		PerfCounters(const PerfCounters &) = delete;
+		PerfCounters &operator=(const PerfCounters &) = delete;
+
+		bool is_open() const{
+			return fds[0] >= 0;
+		}
+
+		const std::string &error() const{
+			return failure;
+		}
+
+		// Starts a new stretch from the current counts
+		void mark();
+
+		// Adds the counts since the last mark into `into`, and marks again
+		void accumulate(PhaseCounters &into);
+
+	private:
+		bool read(uint64_t values[EVENTS]);
+
+		int fds[EVENTS] = {-1, -1, -1, -1, -1};
+		uint64_t last[EVENTS] = {};
+		std::string failure;
+};
+
+#endif
@@ -0,0 +1,217 @@
+#ifndef PHILOX_H
+#define PHILOX_H
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+#include "simd_level.h"
+
+/*
+ * Philox4x32-10 counter-based generator (Salmon et al., "Parallel random
+ * numbers: as easy as 1, 2, 3", SC 2011).
+ *
+ * There is no state to advance: 128 bits of counter and 64 bits of key go
+ * in, 128 random bits come out. Any draw can be computed on its own, in any
+ * order, on any thread, and gives the same bits every time. Ten rounds of
+ * multiply-xor with a bumped key pass the BigCrush tests.
+ */
+namespace philox{
+
+	const uint32_t M0 = 0xD2511F53;
+	const uint32_t M1 = 0xCD9E8D57;
+	const uint32_t W0 = 0x9E3779B9;
+	const uint32_t W1 = 0xBB67AE85;
+	const int ROUNDS = 10;
+
+	inline void generate(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4]){
+		uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+		uint32_t k0 = key[0], k1 = key[1];
+
+		for (int r = 0; r < ROUNDS; r++){
+			uint64_t p0 = uint64_t(M0) * c0;
+			uint64_t p1 = uint64_t(M1) * c2;
+			uint32_t n0 = uint32_t(p1 >> 32) ^ c1 ^ k0;
+			uint32_t n2 = uint32_t(p0 >> 32) ^ c3 ^ k1;
+			c0 = n0;
+			c1 = uint32_t(p1);
+			c2 = n2;
+			c3 = uint32_t(p0);
+			k0 += W0;
+			k1 += W1;
+		}
+
+		out[0] = c0;
+		out[1] = c1;
+		out[2] = c2;
+		out[3] = c3;
+	}
+
+	// Top 24 bits of r as a float in [0, 1)
+	inline float to_unit(uint32_t r){
+		return static_cast<float>(static_cast<int32_t>(r >> 8)) * (1.0f / 16777216.0f);
+	}
+}
+
+/*
+ * Two uniform samples in [low, high) per particle for one tick. Particle i
+ * uses counter (ids[i], tick, stream) under key seed, and takes its x sample
+ * from the first output word and its y sample from the second. The samples
+ * follow the particle's stable id, not where it is stored, so reordering or
+ * splitting the loop never changes them.
+ */
+struct NoiseParams{
+	uint64_t seed;
+	uint64_t tick;
+	uint32_t stream;
+	float low;
+	float high;
+};
+
+using NoiseKernel = void (*)(const uint32_t *ids, size_t count, const NoiseParams &params,
+		float *out_x, float *out_y);
+
+/*
+ * The vector kernels are held to this one bit for bit. Under -march flags
+ * with FMA, low + span * u would be fused into one rounding there, so
+ * contraction is kept off.
+ */
+__attribute__((optimize("fp-contract=off")))
+inline void noise_scalar(const uint32_t *ids, size_t count, const NoiseParams &params,
+		float *out_x, float *out_y){
+
+	const uint32_t key[2] = {uint32_t(params.seed), uint32_t(params.seed >> 32)};
+	const float span = params.high - params.low;
+
+	for (size_t i = 0; i < count; i++){
+		const uint32_t counter[4] = {ids[i], uint32_t(params.tick), uint32_t(params.tick >> 32), params.stream};
+		uint32_t r[4];
+		philox::generate(counter, key, r);
+		out_x[i] = params.low + span * philox::to_unit(r[0]);
+		out_y[i] = params.low + span * philox::to_unit(r[1]);
+	}
+}
+
+#if SIMD_X86
+
+/*
+ * The vector versions run one particle per lane. The 32 x 32 -> 64-bit
+ * multiplies only exist for the even lanes, so the odd lanes are shifted
+ * down and multiplied separately, then the low and high halves are blended
+ * back together. The float conversion keeps multiply and add separate so
+ * the samples match noise_scalar bit for bit.
+ */
+__attribute__((target("avx2,fma"), optimize("fp-contract=off")))
+inline void noise_avx2(const uint32_t *ids, size_t count, const NoiseParams &params,
+		float *out_x, float *out_y){
+
+	const __m256i m0 = _mm256_set1_epi32(static_cast<int>(philox::M0));
+	const __m256i m1 = _mm256_set1_epi32(static_cast<int>(philox::M1));
+	const __m256 scale = _mm256_set1_ps(1.0f / 16777216.0f);
+	const __m256 low = _mm256_set1_ps(params.low);
+	const __m256 span = _mm256_set1_ps(params.high - params.low);
+	const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+	for (size_t i = 0; i < count; i += 8){
+		__m256i live = _mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(std::min<size_t>(count - i, 8))), lane);
+
+		__m256i c0 = _mm256_maskload_epi32(reinterpret_cast<const int *>(ids + i), live);
+		__m256i c1 = _mm256_set1_epi32(static_cast<int>(uint32_t(params.tick)));
+		__m256i c2 = _mm256_set1_epi32(static_cast<int>(uint32_t(params.tick >> 32)));
+		__m256i c3 = _mm256_set1_epi32(static_cast<int>(params.stream));
+		uint32_t k0 = uint32_t(params.seed);
+		uint32_t k1 = uint32_t(params.seed >> 32);
+
+		for (int r = 0; r < philox::ROUNDS; r++){
+			__m256i p0_even = _mm256_mul_epu32(c0, m0);
+			__m256i p0_odd = _mm256_mul_epu32(_mm256_srli_epi64(c0, 32), m0);
+			__m256i p1_even = _mm256_mul_epu32(c2, m1);
+			__m256i p1_odd = _mm256_mul_epu32(_mm256_srli_epi64(c2, 32), m1);
+
+			__m256i lo0 = _mm256_blend_epi32(p0_even, _mm256_slli_epi64(p0_odd, 32), 0xAA);
+			__m256i hi0 = _mm256_blend_epi32(_mm256_srli_epi64(p0_even, 32), p0_odd, 0xAA);
+			__m256i lo1 = _mm256_blend_epi32(p1_even, _mm256_slli_epi64(p1_odd, 32), 0xAA);
+			__m256i hi1 = _mm256_blend_epi32(_mm256_srli_epi64(p1_even, 32), p1_odd, 0xAA);
+
+			c0 = _mm256_xor_si256(_mm256_xor_si256(hi1, c1), _mm256_set1_epi32(static_cast<int>(k0)));
+			c1 = lo1;
+			c2 = _mm256_xor_si256(_mm256_xor_si256(hi0, c3), _mm256_set1_epi32(static_cast<int>(k1)));
+			c3 = lo0;
+			k0 += philox::W0;
+			k1 += philox::W1;
+		}
+
+		__m256 ux = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(c0, 8)), scale);
+		__m256 uy = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(c1, 8)), scale);
+		_mm256_maskstore_ps(out_x + i, live, _mm256_add_ps(low, _mm256_mul_ps(span, ux)));
+		_mm256_maskstore_ps(out_y + i, live, _mm256_add_ps(low, _mm256_mul_ps(span, uy)));
+	}
+}
+
+__attribute__((target("avx512f"), optimize("fp-contract=off")))
+inline void noise_avx512(const uint32_t *ids, size_t count, const NoiseParams &params,
+		float *out_x, float *out_y){
+
+	const __m512i m0 = _mm512_set1_epi32(static_cast<int>(philox::M0));
+	const __m512i m1 = _mm512_set1_epi32(static_cast<int>(philox::M1));
+	const __m512 scale = _mm512_set1_ps(1.0f / 16777216.0f);
+	const __m512 low = _mm512_set1_ps(params.low);
+	const __m512 span = _mm512_set1_ps(params.high - params.low);
+	const __mmask16 odd = 0xAAAA;
+
+	// Zero-masked forms throughout, as the unmasked ones trip GCC 12's uninitialised warnings
+	const __mmask8 all = 0xff;
+
+	for (size_t i = 0; i < count; i += 16){
+		__mmask16 live = count - i >= 16 ? __mmask16(0xffff) : __mmask16((1u << (count - i)) - 1);
+
+		__m512i c0 = _mm512_maskz_loadu_epi32(live, ids + i);
+		__m512i c1 = _mm512_set1_epi32(static_cast<int>(uint32_t(params.tick)));
+		__m512i c2 = _mm512_set1_epi32(static_cast<int>(uint32_t(params.tick >> 32)));
+		__m512i c3 = _mm512_set1_epi32(static_cast<int>(params.stream));
+		uint32_t k0 = uint32_t(params.seed);
+		uint32_t k1 = uint32_t(params.seed >> 32);
+
+		for (int r = 0; r < philox::ROUNDS; r++){
+			__m512i p0_even = _mm512_maskz_mul_epu32(all, c0, m0);
+			__m512i p0_odd = _mm512_maskz_mul_epu32(all, _mm512_maskz_srli_epi64(all, c0, 32), m0);
+			__m512i p1_even = _mm512_maskz_mul_epu32(all, c2, m1);
+			__m512i p1_odd = _mm512_maskz_mul_epu32(all, _mm512_maskz_srli_epi64(all, c2, 32), m1);
+
+			__m512i lo0 = _mm512_mask_blend_epi32(odd, p0_even, _mm512_maskz_slli_epi64(all, p0_odd, 32));
+			__m512i hi0 = _mm512_mask_blend_epi32(odd, _mm512_maskz_srli_epi64(all, p0_even, 32), p0_odd);
+			__m512i lo1 = _mm512_mask_blend_epi32(odd, p1_even, _mm512_maskz_slli_epi64(all, p1_odd, 32));
+			__m512i hi1 = _mm512_mask_blend_epi32(odd, _mm512_maskz_srli_epi64(all, p1_even, 32), p1_odd);
+
+			c0 = _mm512_xor_si512(_mm512_xor_si512(hi1, c1), _mm512_set1_epi32(static_cast<int>(k0)));
+			c1 = lo1;
+			c2 = _mm512_xor_si512(_mm512_xor_si512(hi0, c3), _mm512_set1_epi32(static_cast<int>(k1)));
+			c3 = lo0;
+			k0 += philox::W0;
+			k1 += philox::W1;
+		}
+
+		__m512 ux = _mm512_mul_ps(_mm512_maskz_cvtepi32_ps(live, _mm512_maskz_srli_epi32(live, c0, 8)), scale);
+		__m512 uy = _mm512_mul_ps(_mm512_maskz_cvtepi32_ps(live, _mm512_maskz_srli_epi32(live, c1, 8)), scale);
+		_mm512_mask_storeu_ps(out_x + i, live, _mm512_add_ps(low, _mm512_mul_ps(span, ux)));
+		_mm512_mask_storeu_ps(out_y + i, live, _mm512_add_ps(low, _mm512_mul_ps(span, uy)));
+	}
+}
+
+#endif
+
+// The kernel for a level from usable_simd_level()
+inline NoiseKernel select_noise_kernel(SimdLevel level){
+	switch (level){
+#if SIMD_X86
+		case SimdLevel::Avx512:
+			return noise_avx512;
+		case SimdLevel::Avx2:
+			return noise_avx2;
+#endif
+		default:
+			return noise_scalar;
+	}
+}
+
+#endif
@@ -0,0 +1,211 @@
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+
+#include "profiler.h"
+
+/*
+ * One thread's events. Only the owning thread writes, and head counts
+ * every event it has ever written, so event i sits in slot i % RING_EVENTS
+ * until event i + RING_EVENTS replaces it. Fields are relaxed atomics so a
+ * reader can copy the ring while it is being written, and then drop what
+ * was overwritten meanwhile by checking head again, as a seqlock does.
+ */
+struct ProfileRing{
+	struct Event{
+		std::atomic<const char *> name{nullptr};
+		std::atomic<uint64_t> begin{0};
+		std::atomic<uint64_t> end{0};
+	};
+
+	std::atomic<uint64_t> head{0};
+	std::atomic<const char *> thread_name{nullptr};
+	std::unique_ptr<Event[]> events{new Event[Profiler::RING_EVENTS]};
+};
+
+// A copied event, and the ring it came from
+struct ProfileEvent{
+	const char *name;
+	uint64_t begin;
+	uint64_t end;
+	size_t thread;
+};
+
+std::atomic<bool> Profiler::active(false);
+
+// Registered rings, and the counter calibration; both only change under registry_lock
+static std::mutex registry_lock;
+static std::vector<std::unique_ptr<ProfileRing>> rings;
+static uint64_t origin_ticks = 0;
+static double ticks_per_us = 0.0;
+
+static thread_local ProfileRing *thread_ring = nullptr;
+
+// Time spent comparing the counter against steady_clock
+static const double CALIBRATION_MS = 20.0;
+
+static ProfileRing *current_ring(){
+	if (!thread_ring){
+		std::lock_guard<std::mutex> lock(registry_lock);
+		rings.emplace_back(new ProfileRing());
+		thread_ring = rings.back().get();
+	}
+	return thread_ring;
+}
+
+void Profiler::enable(){
+	{
+		std::lock_guard<std::mutex> lock(registry_lock);
+		if (ticks_per_us == 0.0){
+#if SIMD_X86
+			auto start = std::chrono::steady_clock::now();
+			uint64_t first = now();
+			std::chrono::duration<double, std::micro> elapsed;
+			do{
+				elapsed = std::chrono::steady_clock::now() - start;
+			} while (elapsed.count() < CALIBRATION_MS * 1000.0);
+			ticks_per_us = double(now() - first) / elapsed.count();
+			origin_ticks = first;
+#else
+			ticks_per_us = 1000.0;
+			origin_ticks = now();
+#endif
+		}
+	}
+	active.store(true, std::memory_order_relaxed);
+}
+
+void Profiler::disable(){
+	active.store(false, std::memory_order_relaxed);
+}
+
+void Profiler::record(const char *name, uint64_t begin, uint64_t end){
+	ProfileRing *ring = current_ring();
+	const uint64_t index = ring->head.load(std::memory_order_relaxed);
+	ProfileRing::Event &event = ring->events[index % RING_EVENTS];
+	event.name.store(name, std::memory_order_relaxed);
+	event.begin.store(begin, std::memory_order_relaxed);
+	event.end.store(end, std::memory_order_relaxed);
+	ring->head.store(index + 1, std::memory_order_release);
+}
+
+void Profiler::set_thread_name(const char *name){
+	current_ring()->thread_name.store(name, std::memory_order_relaxed);
+}
+
+/*
+ * Copies out every event that was not overwritten while it was being read,
+ * leaving out those that ended before since. A thread records its events
+ * as they end, so each ring is scanned back from its head only as far as
+ * since.
+ */
+static std::vector<ProfileEvent> collect(std::vector<const char *> &thread_names, uint64_t since = 0){
+	std::lock_guard<std::mutex> lock(registry_lock);
+	std::vector<ProfileEvent> events;
+	thread_names.clear();
+
+	for (size_t r = 0; r < rings.size(); r++){
+		ProfileRing &ring = *rings[r];
+		thread_names.push_back(ring.thread_name.load(std::memory_order_relaxed));
+
+		const uint64_t head = ring.head.load(std::memory_order_acquire);
+		uint64_t first = head > Profiler::RING_EVENTS ? head - Profiler::RING_EVENTS : 0;
+		for (uint64_t i = head; since > 0 && i > first; i--){
+			if (ring.events[(i - 1) % Profiler::RING_EVENTS].end.load(std::memory_order_relaxed) < since){
+				first = i;
+				break;
+			}
+		}
+		const size_t start = events.size();
+		for (uint64_t i = first; i < head; i++){
+			const ProfileRing::Event &event = ring.events[i % Profiler::RING_EVENTS];
+			events.push_back({event.name.load(std::memory_order_relaxed), event.begin.load(std::memory_order_relaxed),
+					event.end.load(std::memory_order_relaxed), r});
+		}
+
+		// Events up to head_after - RING_EVENTS may have been replaced under the copy
+		std::atomic_thread_fence(std::memory_order_acquire);
+		const uint64_t head_after = ring.head.load(std::memory_order_relaxed);
+		if (head_after + 1 > first + Profiler::RING_EVENTS){
+			const uint64_t stale = std::min<uint64_t>(head_after + 1 - Profiler::RING_EVENTS - first, head - first);
+			events.erase(events.begin() + start, events.begin() + start + stale);
+		}
+	}
+	return events;
+}
+
+bool Profiler::write_trace(const std::string &path){
+	std::vector<const char *> thread_names;
+	std::vector<ProfileEvent> events = collect(thread_names);
+	const double scale = ticks_per_us > 0.0 ? 1.0 / ticks_per_us : 0.0;
+
+	std::ofstream out(path);
+	if (!out){
+		return false;
+	}
+	out.setf(std::ios::fixed);
+	out.precision(3);
+	out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+	for (size_t t = 0; t < thread_names.size(); t++){
+		out << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << t
+			<< ", \"args\": {\"name\": \"" << (thread_names[t] ? thread_names[t] : "thread") << " " << t << "\"}},\n";
+	}
+	for (size_t k = 0; k < events.size(); k++){
+		const ProfileEvent &event = events[k];
+		const double start = double(int64_t(event.begin - origin_ticks)) * scale;
+		const double duration = double(event.end - event.begin) * scale;
+		out << "{\"name\": \"" << event.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << event.thread
+			<< ", \"ts\": " << start << ", \"dur\": " << duration << "}" << (k + 1 < events.size() ? ",\n" : "\n");
+	}
+	out << "]}\n";
+	return bool(out);
+}
+
+std::vector<ProfileStat> Profiler::summary(double window_ms){
+	const uint64_t until = now();
+	const uint64_t window = static_cast<uint64_t>(window_ms * 1000.0 * ticks_per_us);
+	const uint64_t since = window_ms > 0.0 && until > window ? until - window : 0;
+
+	std::vector<const char *> thread_names;
+	std::vector<ProfileEvent> events = collect(thread_names, since);
+	const double ms_per_tick = ticks_per_us > 0.0 ? 0.001 / ticks_per_us : 0.0;
+
+	// Grouped by the name's pointer, then merged by text in case one name has several copies
+	std::map<const char *, std::vector<double>> by_pointer;
+	for (const ProfileEvent &event : events){
+		by_pointer[event.name].push_back(double(event.end - event.begin) * ms_per_tick);
+	}
+	std::map<std::string, std::vector<double>> durations;
+	for (auto &entry : by_pointer){
+		std::vector<double> &values = durations[entry.first];
+		values.insert(values.end(), entry.second.begin(), entry.second.end());
+	}
+
+	std::vector<ProfileStat> stats;
+	for (auto &entry : durations){
+		std::vector<double> &values = entry.second;
+		const size_t p50 = (values.size() - 1) / 2;
+		const size_t p99 = (values.size() - 1) * 99 / 100;
+		// Only three ranks are needed, so the values are partitioned rather than sorted
+		std::nth_element(values.begin(), values.begin() + p99, values.end());
+		std::nth_element(values.begin(), values.begin() + p50, values.begin() + p99);
+		ProfileStat stat;
+		stat.name = entry.first;
+		stat.count = values.size();
+		stat.p50_ms = values[p50];
+		stat.p99_ms = values[p99];
+		stat.max_ms = *std::max_element(values.begin() + p99, values.end());
+		stats.push_back(stat);
+	}
+	return stats;
+}
+
+void Profiler::print_summary(std::ostream &out, double window_ms){
+	for (const ProfileStat &stat : summary(window_ms)){
+		out << "profile: " << stat.name << std::string(stat.name.size() < 14 ? 14 - stat.name.size() : 1, ' ')
+			<< "p50 " << stat.p50_ms << " ms, p99 " << stat.p99_ms << " ms, max " << stat.max_ms
+			<< " ms (" << stat.count << ")\n";
+	}
+}
@@ -0,0 +1,105 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <chrono>
+#include <cstdint>
+
+#include "simd_level.h"
+
+/*
+ * In-process profiler for named scopes, meant to stay compiled into the
+ * production build.
+ *
+ * While it is off, a ProfileScope costs one relaxed atomic load. While it
+ * is on, each scope reads the timestamp counter twice and writes one event
+ * into a ring owned by the thread it ran on, with no locks. A ring keeps
+ * the last RING_EVENTS events of its thread, and rings outlive their
+ * threads so a trace can still show them.
+ *
+ * The events can be written out as Chrome trace JSON, which chrome://tracing
+ * and ui.perfetto.dev open, or summarised per scope name as p50 / p99 over
+ * a recent window.
+ *
+ * Scope names must be string literals or otherwise live for the whole run;
+ * only the pointer is stored.
+ */
+
+// Percentiles of one scope name's durations, in milliseconds
+struct ProfileStat{
+	std::string name;
+	size_t count = 0;
+	double p50_ms = 0.0;
+	double p99_ms = 0.0;
+	double max_ms = 0.0;
+};
+
+class Profiler{
+
+	public:
+		static const size_t RING_EVENTS = 1 << 16;
+
+		// Starts recording; the first call calibrates the counter against steady_clock
+		static void enable();
+		static void disable();
+
+		static bool enabled(){
+			return active.load(std::memory_order_relaxed);
+		}
+
+		// The timestamp counter where there is one, else steady_clock in nanoseconds
+		static uint64_t now(){
+#if SIMD_X86
+			return __rdtsc();
+#else
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(
+					std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+		}
+
+		static void record(const char *name, uint64_t begin, uint64_t end);
+
+		// Labels the calling thread's track in traces
+		static void set_thread_name(const char *name);
+
+		// Every event still in the rings as Chrome trace JSON; false if the file cannot be written
+		static bool write_trace(const std::string &path);
+
+		// Per name, over events that ended in the last window_ms, or over all of them for 0
+		static std::vector<ProfileStat> summary(double window_ms);
+
+		static void print_summary(std::ostream &out, double window_ms);
+
+	private:
+		static std::atomic<bool> active;
+};
+
+// Times the enclosing scope under name while the profiler is on
+class ProfileScope{
+
+	public:
+		explicit ProfileScope(const char *name){
+			if (Profiler::enabled()){
+				this->name = name;
+				begin = Profiler::now();
+			}
+		}
+
+		~ProfileScope(){
+			if (name){
+				Profiler::record(name, begin, Profiler::now());
+			}
+		}
+
+		ProfileScope(const ProfileScope &) = delete;
+		ProfileScope &operator=(const ProfileScope &) = delete;
+
+	private:
+		const char *name = nullptr;
+		uint64_t begin = 0;
+};
+
+#endif
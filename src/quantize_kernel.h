@@ -0,0 +1,98 @@
+#ifndef QUANTIZE_KERNEL_H
+#define QUANTIZE_KERNEL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+
+#include "simd_level.h"
+
+/*
+ * Packs positions for rendering: each coordinate is clamped to the [-1, 1]
+ * box and stored as round(v * QUANTIZE_SCALE) in a signed 16-bit integer,
+ * x then y for each particle, 4 bytes a vertex instead of a whole Particle.
+ * The vertex shader divides by the same scale to decode.
+ *
+ * x and y are plain arrays of count floats; out takes 2 * count values.
+ */
+const float QUANTIZE_SCALE = 32767.0f;
+
+using QuantizeKernel = void (*)(const float *x, const float *y, size_t count, int16_t *out);
+
+inline void quantize_scalar(const float *x, const float *y, size_t count, int16_t *out){
+	for (size_t i = 0; i < count; i++){
+		float qx = std::min(std::max(x[i], -1.0f), 1.0f) * QUANTIZE_SCALE;
+		float qy = std::min(std::max(y[i], -1.0f), 1.0f) * QUANTIZE_SCALE;
+		out[2 * i] = static_cast<int16_t>(std::nearbyint(qx));
+		out[2 * i + 1] = static_cast<int16_t>(std::nearbyint(qy));
+	}
+}
+
+#if SIMD_X86
+
+/*
+ * The vector versions round with the current rounding mode, as nearbyint
+ * does, so they match quantize_scalar exactly. Each 32-bit lane ends up
+ * as x in the low half and y in the high half, which in memory is the
+ * (x, y) pair of int16s.
+ */
+__attribute__((target("avx2,fma")))
+inline void quantize_avx2(const float *x, const float *y, size_t count, int16_t *out){
+	const __m256 low = _mm256_set1_ps(-1.0f);
+	const __m256 high = _mm256_set1_ps(1.0f);
+	const __m256 scale = _mm256_set1_ps(QUANTIZE_SCALE);
+	const __m256i low_half = _mm256_set1_epi32(0xffff);
+	const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+	for (size_t i = 0; i < count; i += 8){
+		__m256i live = _mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(std::min<size_t>(count - i, 8))), lane);
+
+		__m256 vx = _mm256_min_ps(_mm256_max_ps(_mm256_maskload_ps(x + i, live), low), high);
+		__m256 vy = _mm256_min_ps(_mm256_max_ps(_mm256_maskload_ps(y + i, live), low), high);
+		__m256i qx = _mm256_cvtps_epi32(_mm256_mul_ps(vx, scale));
+		__m256i qy = _mm256_cvtps_epi32(_mm256_mul_ps(vy, scale));
+
+		__m256i packed = _mm256_or_si256(_mm256_and_si256(qx, low_half), _mm256_slli_epi32(qy, 16));
+		_mm256_maskstore_epi32(reinterpret_cast<int *>(out + 2 * i), live, packed);
+	}
+}
+
+__attribute__((target("avx512f")))
+inline void quantize_avx512(const float *x, const float *y, size_t count, int16_t *out){
+	const __m512 low = _mm512_set1_ps(-1.0f);
+	const __m512 high = _mm512_set1_ps(1.0f);
+	const __m512 scale = _mm512_set1_ps(QUANTIZE_SCALE);
+	const __m512i low_half = _mm512_set1_epi32(0xffff);
+
+	for (size_t i = 0; i < count; i += 16){
+		__mmask16 live = count - i >= 16 ? __mmask16(0xffff) : __mmask16((1u << (count - i)) - 1);
+
+		// Zero-masked forms, as the unmasked ones trip GCC 12's uninitialised warnings
+		__m512 vx = _mm512_maskz_min_ps(live, _mm512_maskz_max_ps(live, _mm512_maskz_loadu_ps(live, x + i), low), high);
+		__m512 vy = _mm512_maskz_min_ps(live, _mm512_maskz_max_ps(live, _mm512_maskz_loadu_ps(live, y + i), low), high);
+		__m512i qx = _mm512_maskz_cvtps_epi32(live, _mm512_mul_ps(vx, scale));
+		__m512i qy = _mm512_maskz_cvtps_epi32(live, _mm512_mul_ps(vy, scale));
+
+		__m512i packed = _mm512_or_si512(_mm512_and_si512(qx, low_half), _mm512_maskz_slli_epi32(live, qy, 16));
+		_mm512_mask_storeu_epi32(out + 2 * i, live, packed);
+	}
+}
+
+#endif
+
+// The kernel for a level from usable_simd_level()
+inline QuantizeKernel select_quantize_kernel(SimdLevel level){
+	switch (level){
+#if SIMD_X86
+		case SimdLevel::Avx512:
+			return quantize_avx512;
+		case SimdLevel::Avx2:
+			return quantize_avx2;
+#endif
+		default:
+			return quantize_scalar;
+	}
+}
+
+#endif
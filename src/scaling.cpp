@@ -0,0 +1,280 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <cstdlib>
+#include <algorithm>
+#include "simulation.h"
+#include "command_line.h"
+#include "measure.h"
+#include "hardware_info.h"
+
+/*
+ * Sweeps thread count against particle count and reports how each phase of
+ * update_particles scales, as CSV, for sizing machines and catching
+ * parallel regressions.
+ *
+ * Strong scaling keeps the particle count fixed while threads are added.
+ * Weak scaling grows the particle count with the threads, a fixed number of
+ * particles per thread. Both are measured against the first thread count
+ * in the list, T0:
+ *
+ *   speedup    = (particles / time) / (particles at T0 / time at T0)
+ *   efficiency = speedup * T0 / threads
+ *
+ * so perfect scaling is an efficiency of 1 in both. Under weak scaling the
+ * solvers that cost more than O(n) per particle lose efficiency as the
+ * count grows even on one thread, which is part of what it shows.
+ *
+ * The CSV starts with "# key: value" lines describing the machine (model,
+ * cores, SMT, caches, SIMD level and clock), then one row per mode,
+ * particle count, thread count and phase.
+ */
+
+const double FIXED_DT = 1.0f / 60.0f;
+
+// Busy time before the first run, for the clock to ramp up
+const double SPIN_UP_SECONDS = 0.5;
+
+struct ScalingOptions{
+	std::vector<long> sizes = {20000, 200000};	// strong scaling
+	std::vector<long> weak = {10000};		// weak scaling, particles per thread
+	std::vector<long> threads;
+	SampleSettings sampling;
+	long direct_limit = 50000;
+	std::string csv = "-";
+	const ScenarioInfo *scenario = find_scenario("uniform");
+	SimulationSettings settings;
+};
+
+// Median milliseconds per tick and their spread, for each phase of one run
+struct RunResult{
+	long particles = 0;
+	long threads = 0;
+	Spread phases[5];
+};
+
+const char *PHASE_NAMES[5] = {"reorder", "long_range", "short_range", "step", "total"};
+
+void print_usage(const char *program){
+	std::cout << "Usage: " << program << " [options]\n"
+		<< "  --sizes LIST        particle counts for strong scaling (default 20000,200000)\n"
+		<< "  --weak LIST         particles per thread for weak scaling (default 10000)\n"
+		<< "  --threads LIST      thread counts, the first is the baseline (default 1, 2, 4 ... up to every CPU)\n"
+		<< "  --solver NAME       direct, barnes-hut, fmm or mesh (default barnes-hut)\n"
+		<< "  --reps N            timed repetitions per run (default 3)\n"
+		<< "  --warmup N          untimed ticks per run (default 1)\n"
+		<< "  --min-time S        least seconds per repetition (default 0.2)\n"
+		<< "  --direct-limit N    largest count the direct solver runs (default 50000)\n"
+		<< "  --seed N            seed, not 0, so runs repeat (default 1)\n"
+		<< "  --csv FILE          where to write the results, - for stdout (default -)\n"
+		<< "  --scenario NAME     starting state (default uniform), one of:\n";
+	print_scenarios(std::cout);
+}
+
+// Fills options from argv; prints what is wrong and returns false on bad input
+bool parse_options(int argc, char **argv, ScalingOptions &options){
+	for (int a = 1; a < argc; a++){
+		std::string flag = argv[a];
+		if (flag == "--help" || flag == "-h"){
+			print_usage(argv[0]);
+			std::exit(0);
+		}
+		if (a + 1 >= argc){
+			std::cerr << "Missing value for " << flag << "\n";
+			return false;
+		}
+		const char *value = argv[++a];
+
+		long number = 0;
+		bool ok = true;
+		if (flag == "--sizes"){
+			ok = parse_list(value, 2, options.sizes, INT_MAX);
+		} else if (flag == "--weak"){
+			ok = parse_list(value, 2, options.weak, INT_MAX);
+		} else if (flag == "--threads"){
+			ok = parse_list(value, 1, options.threads, INT_MAX);
+		} else if (flag == "--solver"){
+			ok = parse_solver(value, options.settings.solver);
+		} else if (flag == "--reps"){
+			ok = parse_number(value, 1, number);
+			options.sampling.reps = number;
+		} else if (flag == "--warmup"){
+			ok = parse_number(value, 0, number);
+			options.sampling.warmup = number;
+		} else if (flag == "--min-time"){
+			char *end = nullptr;
+			options.sampling.min_time = std::strtod(value, &end);
+			ok = end != value && *end == '\0' && options.sampling.min_time >= 0.0;
+		} else if (flag == "--direct-limit"){
+			ok = parse_number(value, 2, number);
+			options.direct_limit = number;
+		} else if (flag == "--seed"){
+			ok = parse_seed(value, options.settings.seed) && options.settings.seed != 0;
+		} else if (flag == "--csv"){
+			options.csv = value;
+		} else if (flag == "--scenario"){
+			options.scenario = find_scenario(value);
+			ok = options.scenario != nullptr;
+		} else{
+			std::cerr << "Unknown option " << flag << "\n";
+			return false;
+		}
+
+		if (!ok){
+			std::cerr << "Bad value for " << flag << ": " << value << "\n";
+			return false;
+		}
+	}
+	return true;
+}
+
+// Powers of two up to the CPU count, then the core count and the CPU count themselves
+std::vector<long> default_threads(const HardwareInfo &hardware){
+	const long cpus = std::max(hardware.logical_cpus, 1);
+	std::vector<long> threads;
+	for (long t = 1; t < cpus; t *= 2){
+		threads.push_back(t);
+	}
+	if (hardware.cores > 0 && hardware.cores < cpus){
+		threads.push_back(hardware.cores);
+	}
+	threads.push_back(cpus);
+	std::sort(threads.begin(), threads.end());
+	threads.erase(std::unique(threads.begin(), threads.end()), threads.end());
+	return threads;
+}
+
+RunResult run(const ScalingOptions &options, long particles, long threads){
+	SimulationSettings settings = options.settings;
+	settings.threads = static_cast<int>(threads);
+
+	RunResult result;
+	result.particles = particles;
+	result.threads = threads;
+
+	Simulation sim(build_scenario(*options.scenario, static_cast<int>(particles), settings.seed, settings.threads),
+			settings);
+	PhaseSamples samples = sample_phases(sim, FIXED_DT, options.sampling);
+	result.phases[0] = spread_of(samples.reorder);
+	result.phases[1] = spread_of(samples.long_range);
+	result.phases[2] = spread_of(samples.short_range);
+	result.phases[3] = spread_of(samples.step);
+	result.phases[4] = spread_of(samples.total);
+
+	std::cerr << "  " << particles << " particles, " << threads << " threads: "
+		<< result.phases[4].median << " ms per tick\n";
+	return result;
+}
+
+void write_hardware(std::ostream &out, const HardwareInfo &hardware, const ScalingOptions &options, SimdLevel simd){
+	const CpuFrequency frequency = read_cpu_frequency();
+	out << "# model: " << hardware.model << "\n"
+		<< "# logical_cpus: " << hardware.logical_cpus << "\n"
+		<< "# cores: " << hardware.cores << "\n"
+		<< "# packages: " << hardware.packages << "\n"
+		<< "# threads_per_core: " << hardware.threads_per_core << "\n"
+		<< "# smt_active: " << (hardware.smt_active ? 1 : 0) << "\n";
+	for (const CacheInfo &cache : hardware.caches){
+		out << "# cache_" << cache_name(cache) << "_kb: " << cache.size_kb << "\n";
+	}
+	if (!hardware.caches.empty()){
+		out << "# cache_line_bytes: " << hardware.caches.front().line_bytes << "\n";
+	}
+	out << "# simd: " << simd_level_name(simd) << "\n"
+		<< "# cpufreq_governor: " << frequency.governor << "\n"
+		<< "# cpu_mhz: " << frequency.mhz << "\n"
+		<< "# scenario: " << options.scenario->name << "\n"
+		<< "# solver: " << solver_name(options.settings.solver) << "\n"
+		<< "# seed: " << options.settings.seed << "\n";
+}
+
+// One row per phase of run, measured against baseline
+void write_rows(std::ostream &out, const char *mode, const RunResult &baseline, const RunResult &run){
+	for (int p = 0; p < 5; p++){
+		const Spread &spread = run.phases[p];
+		const double base = baseline.phases[p].median;
+		double speedup = 0.0;
+		if (spread.median > 0.0 && base > 0.0){
+			speedup = (double(run.particles) / spread.median) / (double(baseline.particles) / base);
+		}
+		const double efficiency = speedup * double(baseline.threads) / double(run.threads);
+
+		out << mode << "," << run.particles << "," << run.threads << "," << PHASE_NAMES[p] << ","
+			<< spread.median << "," << spread.min << "," << spread.max << "," << spread.rsd << ","
+			<< speedup << "," << efficiency << "\n";
+	}
+}
+
+int main(int argc, char **argv){
+	ScalingOptions options;
+	options.settings.solver = Solver::BarnesHut;
+	options.settings.seed = 1;
+	options.sampling.reps = 3;
+	options.sampling.warmup = 1;
+	if (!parse_options(argc, argv, options)){
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	const HardwareInfo hardware = read_hardware_info();
+	if (options.threads.empty()){
+		options.threads = default_threads(hardware);
+	}
+
+	std::ofstream file;
+	if (options.csv != "-"){
+		file.open(options.csv);
+		if (!file){
+			std::cerr << "Cannot write " << options.csv << "\n";
+			return 1;
+		}
+	}
+	std::ostream &out = options.csv == "-" ? std::cout : file;
+
+	// Only used for the SIMD level the kernels run at
+	Simulation probe(2, options.settings);
+	write_hardware(out, hardware, options, probe.get_simd_level());
+	out << "mode,particles,threads,phase,median_ms,min_ms,max_ms,rsd,speedup,efficiency\n";
+
+	spin_up(SPIN_UP_SECONDS);
+	auto too_big = [&](long particles){
+		return options.settings.solver == Solver::Direct && particles > options.direct_limit;
+	};
+
+	for (long particles : options.sizes){
+		if (too_big(particles)){
+			std::cerr << "strong " << particles << " skipped: above --direct-limit for the direct solver\n";
+			continue;
+		}
+		std::cerr << "strong scaling, " << particles << " particles\n";
+		RunResult baseline = run(options, particles, options.threads.front());
+		write_rows(out, "strong", baseline, baseline);
+		for (size_t k = 1; k < options.threads.size(); k++){
+			write_rows(out, "strong", baseline, run(options, particles, options.threads[k]));
+		}
+	}
+
+	for (long per_thread : options.weak){
+		std::cerr << "weak scaling, " << per_thread << " particles per thread\n";
+		RunResult baseline;
+		for (size_t k = 0; k < options.threads.size(); k++){
+			const long particles = per_thread * options.threads[k];
+			if (particles > INT_MAX){
+				std::cerr << "weak " << particles << " skipped: more particles than a simulation holds\n";
+				break;
+			}
+			if (too_big(particles)){
+				std::cerr << "weak " << particles << " skipped: above --direct-limit for the direct solver\n";
+				break;
+			}
+			RunResult result = run(options, particles, options.threads[k]);
+			if (k == 0){
+				baseline = result;
+			}
+			write_rows(out, "weak", baseline, result);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,160 @@
+#include <random>
+#include <cmath>
+#include <algorithm>
+
+#include "scenarios.h"
+#include "simulation.h"
+
+// Evolved states run at the viewer's 60 Hz
+const float SCENARIO_DT = 1.0f / 60.0f;
+
+// Shapes of the generated states, in box units (the walls are at +-1) and box units per second
+const float CLUSTER_RADIUS = 0.1f;
+const float CLUSTER_SPEED = 0.05f;
+const float BLOB_RADIUS = 0.1f;
+const float BIMODAL_OFFSET = 0.5f;
+const float BIMODAL_RADIUS = 0.08f;
+const float BIMODAL_SPEED = 0.2f;
+const float WALL_DEPTH = 0.02f;
+const float WALL_SPEED = 0.5f;
+
+// Keeps a drawn position inside the walls at +-1
+static float in_box(float v){
+	return std::min(std::max(v, -1.0f), 1.0f);
+}
+
+// Same draws, in the same order, as Simulation's own random start
+static void generate_uniform(std::vector<Particle> &state, std::mt19937 &gen){
+	std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+	for (Particle &p : state){
+		p.x = dist(gen);
+		p.y = dist(gen);
+		p.vx = dist(gen);
+		p.vy = dist(gen);
+	}
+}
+
+static void generate_cluster(std::vector<Particle> &state, std::mt19937 &gen){
+	std::normal_distribution<float> position(0.0f, CLUSTER_RADIUS);
+	std::normal_distribution<float> velocity(0.0f, CLUSTER_SPEED);
+	for (Particle &p : state){
+		p.x = in_box(position(gen));
+		p.y = in_box(position(gen));
+		p.vx = velocity(gen);
+		p.vy = velocity(gen);
+	}
+}
+
+// Uniform over the disc: radius from the square root keeps the density even
+static void generate_blob(std::vector<Particle> &state, std::mt19937 &gen){
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	for (Particle &p : state){
+		float r = BLOB_RADIUS * std::sqrt(unit(gen));
+		float angle = 2.0f * float(M_PI) * unit(gen);
+		p.x = r * std::cos(angle);
+		p.y = r * std::sin(angle);
+		p.vx = 0.0f;
+		p.vy = 0.0f;
+	}
+}
+
+// The first half of the ids go left, the rest right
+static void generate_bimodal(std::vector<Particle> &state, std::mt19937 &gen){
+	std::normal_distribution<float> position(0.0f, BIMODAL_RADIUS);
+	for (size_t i = 0; i < state.size(); i++){
+		const float side = i < state.size() / 2 ? -1.0f : 1.0f;
+		Particle &p = state[i];
+		p.x = in_box(side * BIMODAL_OFFSET + position(gen));
+		p.y = in_box(position(gen));
+		p.vx = -side * BIMODAL_SPEED;
+		p.vy = 0.0f;
+	}
+}
+
+static void generate_wall(std::vector<Particle> &state, std::mt19937 &gen){
+	std::uniform_real_distribution<float> depth(1.0f - WALL_DEPTH, 1.0f);
+	std::uniform_real_distribution<float> along(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> speed(0.0f, WALL_SPEED);
+	for (Particle &p : state){
+		p.x = depth(gen);
+		p.y = along(gen);
+		p.vx = speed(gen);
+		p.vy = 0.0f;
+	}
+}
+
+const std::vector<ScenarioInfo> &scenario_catalog(){
+	static const std::vector<ScenarioInfo> catalog = {
+		{"uniform", Scenario::Uniform, 0, "uniform positions and velocities, the default start"},
+		{"cluster", Scenario::Cluster, 0, "collapsed cluster around the centre"},
+		{"blob", Scenario::Blob, 0, "dense disc at rest, repulsion everywhere"},
+		{"bimodal", Scenario::Bimodal, 0, "two clusters heading into each other"},
+		{"wall", Scenario::Wall, 0, "thin sheet moving into the right wall"},
+		{"uniform-evolved", Scenario::Uniform, 300, "uniform start after 5 s of gravity and wind"},
+		{"blob-evolved", Scenario::Blob, 60, "dense disc after 1 s of blowing apart"},
+		{"bimodal-evolved", Scenario::Bimodal, 180, "two clusters after 3 s, through their collision"}
+	};
+	return catalog;
+}
+
+const ScenarioInfo *find_scenario(const std::string &name){
+	for (const ScenarioInfo &info : scenario_catalog()){
+		if (name == info.name){
+			return &info;
+		}
+	}
+	return nullptr;
+}
+
+std::vector<Particle> generate_scenario(Scenario scenario, int count, uint64_t seed){
+	// Seeded as Simulation seeds its own generator
+	std::seed_seq seq{uint32_t(seed), uint32_t(seed >> 32)};
+	std::mt19937 gen(seq);
+
+	std::vector<Particle> state(count);
+	switch (scenario){
+		case Scenario::Uniform:
+			generate_uniform(state, gen);
+			break;
+		case Scenario::Cluster:
+			generate_cluster(state, gen);
+			break;
+		case Scenario::Blob:
+			generate_blob(state, gen);
+			break;
+		case Scenario::Bimodal:
+			generate_bimodal(state, gen);
+			break;
+		case Scenario::Wall:
+			generate_wall(state, gen);
+			break;
+	}
+	return state;
+}
+
+std::vector<Particle> build_scenario(const ScenarioInfo &info, int count, uint64_t seed, int threads){
+	std::vector<Particle> state = generate_scenario(info.scenario, count, seed);
+	if (info.evolve_ticks <= 0){
+		return state;
+	}
+
+	/*
+	 * The vector kernels only agree with the scalar ones to rounding,
+	 * and that grows over the ticks, so evolution always runs scalar.
+	 * Everything else that could change the result is pinned as well.
+	 */
+	SimulationSettings settings;
+	settings.solver = Solver::BarnesHut;
+	settings.max_simd = SimdLevel::Scalar;
+	settings.reorder_interval = 0;
+	settings.neighbor_lists = false;
+	settings.seed = seed;
+	settings.threads = threads;
+
+	Simulation sim(state, settings);
+	for (int t = 0; t < info.evolve_ticks; t++){
+		sim.update_particles(SCENARIO_DT);
+	}
+	sim.export_particles_by_id(state.data());
+	return state;
+}
@@ -0,0 +1,57 @@
+#ifndef SCENARIOS_H
+#define SCENARIOS_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "particle.h"
+
+/*
+ * Named starting states for benchmarking, so solvers and threading are
+ * measured on clustered and wall-bound distributions and not only on the
+ * uniform start, which is the easiest case for every solver.
+ *
+ * Every state is drawn from its seed alone: the same name, count and seed
+ * give the same particles, in id order, with the same standard library
+ * and core build flags, whatever instruction set the machine has.
+ */
+enum class Scenario{
+	Uniform,	// positions and velocities uniform in the box, the default start
+	Cluster,	// a collapsed cluster: tight Gaussian around the centre, slow
+	Blob,		// a dense disc at rest, every pair inside the repulsion range
+	Bimodal,	// two Gaussian clusters heading into each other
+	Wall		// a thin sheet against the right wall, moving into it
+};
+
+/*
+ * A catalog entry: a generator, and how many ticks to run it for before
+ * handing the state out. Evolved entries stand for the state a scene is in
+ * once it has been running, rather than how it starts.
+ */
+struct ScenarioInfo{
+	const char *name;
+	Scenario scenario;
+	int evolve_ticks;
+	const char *description;
+};
+
+const std::vector<ScenarioInfo> &scenario_catalog();
+
+// The entry called name, or nullptr
+const ScenarioInfo *find_scenario(const std::string &name);
+
+// count particles drawn for scenario from seed
+std::vector<Particle> generate_scenario(Scenario scenario, int count, uint64_t seed);
+
+/*
+ * The generated state run for info.evolve_ticks ticks. Evolution always
+ * uses Barnes-Hut with the scalar kernels, no reordering and no neighbour
+ * lists, whatever solver and settings the state is then measured with, so
+ * every solver and every machine starts from the same particles. threads
+ * only changes how long that takes; its cost grows with count like any
+ * other run.
+ */
+std::vector<Particle> build_scenario(const ScenarioInfo &info, int count, uint64_t seed, int threads = 0);
+
+#endif
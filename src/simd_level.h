@@ -0,0 +1,58 @@
+#ifndef SIMD_LEVEL_H
+#define SIMD_LEVEL_H
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_X86 1
+#else
+#define SIMD_X86 0
+#endif
+
+// Widest vector instruction set the kernels may use
+enum class SimdLevel{
+	Scalar,
+	Avx2,		// 8 floats at a time, AVX2 + FMA
+	Avx512		// 16 floats at a time, AVX-512F
+};
+
+// What this CPU supports, read once through cpuid
+inline SimdLevel detect_simd_level(){
+#if SIMD_X86
+	static const SimdLevel level = []{
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx512f")){
+			return SimdLevel::Avx512;
+		}
+		if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")){
+			return SimdLevel::Avx2;
+		}
+		return SimdLevel::Scalar;
+	}();
+	return level;
+#else
+	return SimdLevel::Scalar;
+#endif
+}
+
+// The widest level that is both supported and no wider than max_level
+inline SimdLevel usable_simd_level(SimdLevel max_level){
+	SimdLevel supported = detect_simd_level();
+#if SIMD_X86
+	return static_cast<int>(supported) < static_cast<int>(max_level) ? supported : max_level;
+#else
+	return supported;
+#endif
+}
+
+inline const char *simd_level_name(SimdLevel level){
+	switch (level){
+		case SimdLevel::Avx512:
+			return "AVX-512";
+		case SimdLevel::Avx2:
+			return "AVX2";
+		default:
+			return "scalar";
+	}
+}
+
+#endif
@@ -1,176 +1,539 @@
-#include <iostream>
-#include <vector>
-#include <random>
 #include <cmath>
-
-struct Particle{
-	float x, y;
-	float vx, vy;
-};
-
-class Simulation{
-
-	public:
-		Simulation(int count): 
-			particles(count), 
-			gen(ran_dev()), 
-			dist(-1.0f, 1.0f), 
-			wind_noise(-0.01f, 0.01f)
-		{
-			set_coordinates();
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+#include "simulation.h"
+#include "profiler.h"
+
+// Definitions for the constants that get bound to references, as std::min does
+const uint32_t Simulation::DIRECT_CHUNK_ROWS;
+const size_t Simulation::MAX_DIRECT_CHUNKS;
+const size_t Simulation::DIRECT_ACC_BYTES;
+const size_t Simulation::REDUCE_SLICE;
+const size_t Simulation::STEP_GRAIN;
+const size_t Simulation::WALK_GRAIN;
+
+Simulation::Simulation(int count, SimulationSettings settings): Simulation(size_t(count), nullptr, settings){
+}
+
+Simulation::Simulation(const std::vector<Particle> &state, SimulationSettings settings):
+	Simulation(state.size(), state.data(), settings){
+}
+
+// Random coordinates from the seed without a state, else a copy of it
+Simulation::Simulation(size_t count, const Particle *state, const SimulationSettings &settings):
+	particles(count), 
+	settings(settings), 
+	seed(settings.seed != 0 ? settings.seed : (uint64_t(ran_dev()) << 32) | ran_dev()),
+	dist(-1.0f, 1.0f), 
+	grid(std::sqrt(DIST_LIMIT)),
+	tree(ATTR_STRENGTH, MIN_DIST_SQR, settings.theta),
+	multipole(ATTR_STRENGTH, MIN_DIST_SQR, settings.fmm_order),
+	mesh(ATTR_STRENGTH, std::sqrt(DIST_LIMIT), settings.mesh_size),
+	verlet(std::sqrt(DIST_LIMIT), settings.verlet_skin),
+	counters(settings.perf_counters),
+	pool(settings.threads > 0 ? size_t(settings.threads) : std::max(1u, std::thread::hardware_concurrency()))
+{
+	std::seed_seq seq{uint32_t(seed), uint32_t(seed >> 32)};
+	gen.seed(seq);
+	if (state){
+		for (size_t i = 0; i < count; i++){
+			particles.set(i, state[i]);
 		}
+	} else{
+		set_coordinates();
+	}
+
+	simd_level = usable_simd_level(settings.max_simd);
+	pair_kernel = select_pair_kernel(simd_level);
+	step_kernel = select_step_kernel(simd_level);
+	noise_kernel = select_noise_kernel(simd_level);
+	quantize_kernel = select_quantize_kernel(simd_level);
+
+	ids.resize(count);
+	slots.resize(count);
+	for (size_t i = 0; i < count; i++){
+		ids[i] = i;
+		slots[i] = i;
+	}
+}
+
+void Simulation::update_particles(float dt){
+	ProfileScope tick_scope("tick");
+
+	// Each phase's time and counts end where the next one starts
+	using Clock = std::chrono::steady_clock;
+	Clock::time_point mark = Clock::now();
+	auto lap = [this, &mark](double &ms, PhaseCounters &counted){
+		Clock::time_point now = Clock::now();
+		ms = std::chrono::duration<double, std::milli>(now - mark).count();
+		mark = now;
+		counters.accumulate(counted);
+	};
+	phase_times = PhaseTimes();
+	counters.mark();
+
+	if (settings.reorder_interval > 0 && tick % settings.reorder_interval == 0){
+		ProfileScope scope("reorder");
+		reorder_particles();
+		lap(phase_times.reorder_ms, phase_counters.reorder);
+	}
+
+	/*
+	 * ======================================
+	 * 1. INTER-PARTICLE ATTRACTION
+	 * ======================================
+	 */
+
+	{
+		ProfileScope scope("long_range");
+		switch (settings.solver){
+			case Solver::Direct:
+				apply_direct(dt);
+				break;
+			case Solver::BarnesHut:
+				apply_long_range_barnes_hut(dt);
+				break;
+			case Solver::FastMultipole:
+				apply_long_range_multipole(dt);
+				break;
+			case Solver::ParticleMesh:
+				apply_long_range_mesh(dt);
+				break;
+		}
+		lap(phase_times.long_range_ms, phase_counters.long_range);
+	}
+
+	if (settings.solver != Solver::Direct){
+		ProfileScope scope("short_range");
+		apply_short_range(dt);
+		lap(phase_times.short_range_ms, phase_counters.short_range);
+	}
+
+	/*
+	 * ======================================
+	 * 2. APPLY FORCES AND UPDATE POSITION
+	 * ======================================
+	 */
+
+	/*
+	 * Gravity, wind and the pull to the centre only touch velocities
+	 * and read positions the pair forces leave alone, so they are
+	 * applied in the same pass as the position update and the wall
+	 * bounce, one read and one write of each particle per tick.
+	 *
+	 * The wind noise comes from a counter-based generator keyed by
+	 * (seed, tick, particle id), so it does not depend on the order
+	 * particles are stored or visited in, or on how the pass is split
+	 * across threads. Tasks take whole blocks.
+	 */
+	ProfileScope step_scope("step");
+	const size_t count = particles.size();
+	const size_t width = ParticleStore::BLOCK_WIDTH;
+	noise_x.resize(count);
+	noise_y.resize(count);
+	const NoiseParams noise{seed, tick, WIND_STREAM, -WIND_NOISE, WIND_NOISE};
+	const StepParams params{dt, GRAVITY, WIND_X, WIND_Y, PULL_MULTIPLIER};
+
+	pool.parallel_for(0, (count + width - 1) / width, STEP_GRAIN / width, [&](size_t b0, size_t b1){
+		const size_t first = b0 * width;
+		const size_t n = std::min(b1 * width, count) - first;
+		noise_kernel(ids.data() + first, n, noise, noise_x.data() + first, noise_y.data() + first);
+		step_kernel(particles.block_x(b0), particles.block_y(b0), particles.block_vx(b0), particles.block_vy(b0),
+				noise_x.data() + first, noise_y.data() + first, n,
+				width, ParticleStore::BLOCK_STRIDE, params);
+	});
+	lap(phase_times.step_ms, phase_counters.step);
+
+	tick++;
+}
+
+void Simulation::export_particles_by_id(Particle *out) const{
+	for (size_t id = 0; id < slots.size(); id++){
+		out[id] = particles.get(slots[id]);
+	}
+}
+
+void Simulation::export_positions_by_id(int16_t *out) const{
+	ParticleStore::ConstColumn x = particles.x();
+	ParticleStore::ConstColumn y = particles.y();
+	render_x.resize(slots.size());
+	render_y.resize(slots.size());
+	for (size_t id = 0; id < slots.size(); id++){
+		render_x[id] = x[slots[id]];
+		render_y[id] = y[slots[id]];
+	}
+	quantize_kernel(render_x.data(), render_y.data(), slots.size(), out);
+}
+
+/*
+ * The pair force is split into two parts that add up to the original
+ * branch on DIST_LIMIT:
+ *
+ *   long range:  ATTR_STRENGTH / d^2 between every pair
+ *   short range: (REP_STRENGTH - ATTR_STRENGTH) / d^2 for d^2 < DIST_LIMIT
+ *
+ * Only the short-range part needs a neighbour search, so it walks the
+ * cell grid instead of all pairs. The direct solver visits every pair
+ * anyway, so it applies the unsplit force in one pass.
+ */
+
+/*
+ * O(n^2) loop as each particle measures it's distance from all other
+ * particles. The square of this distance is used to find the force
+ * to be applied via inverse-square law. This force is applied to both
+ * particles as per Newton's 3rd law: each force begets an equal and
+ * opposite force.
+ *
+ * Each row, particle i against every j > i, goes through the pair
+ * kernel, which picks attraction or repulsion per pair with a mask.
+ *
+ * Rows are split into chunks that each hold about the same number of
+ * pairs, and each chunk adds its forces into an accumulator of its
+ * own, so the symmetric update never races. The accumulators are then
+ * summed element by element in chunk order. How the rows are chunked
+ * depends only on the particle count, never on the thread count, so
+ * the result is bitwise the same however many threads run it.
+ */
+void Simulation::apply_direct(float dt){
+	const uint32_t count = static_cast<uint32_t>(particles.size());
+	ParticleStore::ConstColumn x = particles.x();
+	ParticleStore::ConstColumn y = particles.y();
+
+	// The kernels want plain arrays, whatever the storage layout
+	pair_x.resize(count);
+	pair_y.resize(count);
+	pool.parallel_for(0, count, STEP_GRAIN, [&](size_t first, size_t last){
+		for (size_t i = first; i < last; i++){
+			pair_x[i] = x[i];
+			pair_y[i] = y[i];
+		}
+	});
 
-		// update particles position
-		void update_particles(float dt){
-
-			/*
-			 * ======================================
-			 * 1. APPLY FORCES TO VELOCITY
-			 * ======================================
-			 */
-
-			for (Particle &p : particles){
-				// Gravity
-				p.vy += -GRAVITY * dt; 
-
-				// Wind 
-				p.vx += (WIND_X + wind_noise(gen)) * dt;
-				p.vy += (WIND_Y + wind_noise(gen)) * dt;
+	split_direct_rows(count);
+	const size_t chunks = chunk_rows.size() - 1;
 
-				// Attract to center
-				float dx = 0.0f - p.x;
-				float dy = 0.0f - p.y;
+	// Each accumulator starts on its own cache line so chunks never share one
+	const size_t line = ParticleStore::ALIGNMENT / sizeof(float);
+	const size_t stride = (count + line - 1) / line * line;
+	pair_acc.resize(chunks * 2 * stride);
 
-				/* 
-				 * Pull multiplier ensures the force gets stronger as distances 
-				 * get smaller
-				 */
+	const PairParams params{REP_STRENGTH, ATTR_STRENGTH, DIST_LIMIT, MIN_DIST_SQR, 0.0f};
+	pool.parallel_for(0, chunks, 1, [&](size_t first, size_t last){
+		for (size_t c = first; c < last; c++){
+			float *ax = pair_acc.data() + c * 2 * stride;
+			float *ay = ax + stride;
+			std::fill(ax, ax + 2 * stride, 0.0f);
 
-				p.vx += dx * PULL_MULTIPLIER * dt;
-				p.vy += dy * PULL_MULTIPLIER * dt;
+			for (uint32_t i = chunk_rows[c]; i < chunk_rows[c + 1]; i++){
+				pair_kernel(pair_x.data(), pair_y.data(), ax, ay, i, i + 1, count, params);
 			}
-
-			/*
-			 * ======================================
-			 * 2. INTER-PARTICLE ATTRACTION
-			 * ======================================
-			 */
-
-			/*
-			 * O(n^2) loop as each particle measures it's distance from all other
-			 * particles. The square of this distance is used to find the force
-			 * to be applied via inverse-square law.This force is applied to both 
-			 * particles as per Newton's 3rd law: each force begets an equal and 
-			 * opposite force. Attraction & Repulsion are both implemented.
-			 */
-
-			for (size_t i = 0; i < particles.size(); i++){
-				for (size_t j = i + 1; j < particles.size(); j++){
-					float dist_x = particles[j].x - particles[i].x;
-					float dist_y = particles[j].y - particles[i].y;
-
-					float dist_sqr = (dist_x * dist_x) + (dist_y * dist_y);
-					if (dist_sqr > 0.0001f){ // avoid division by 0
-						float dist = sqrt(dist_sqr);
-
-						float force;
-						if (dist_sqr < DIST_LIMIT){
-							force = REP_STRENGTH / dist_sqr;
-						} else{
-							force = ATTR_STRENGTH / dist_sqr;
+		}
+	});
+
+	ParticleStore::Column vx = particles.vx();
+	ParticleStore::Column vy = particles.vy();
+	pool.parallel_for(0, count, REDUCE_SLICE, [&](size_t first, size_t last){
+		for (size_t i = first; i < last; i++){
+			float sum_x = 0.0f;
+			float sum_y = 0.0f;
+			for (size_t c = 0; c < chunks; c++){
+				sum_x += pair_acc[c * 2 * stride + i];
+				sum_y += pair_acc[c * 2 * stride + stride + i];
+			}
+			vx[i] += sum_x * dt;
+			vy[i] += sum_y * dt;
+		}
+	});
+}
+
+/*
+ * Chunk boundaries for apply_direct: rows before row i hold
+ * i * n - i * (i + 1) / 2 pairs, and chunk c starts at the first row
+ * where that reaches c / chunks of all pairs. The chunk count still only
+ * depends on the particle count: at most one per DIRECT_CHUNK_ROWS rows,
+ * and no more than fit their accumulators into DIRECT_ACC_BYTES.
+ */
+void Simulation::split_direct_rows(uint32_t count){
+	const size_t chunk_bytes = 2 * sizeof(float) * std::max<size_t>(count, 1);
+	size_t chunks = std::min<size_t>(MAX_DIRECT_CHUNKS, std::max<size_t>(1, count / DIRECT_CHUNK_ROWS));
+	chunks = std::min(chunks, std::max<size_t>(1, DIRECT_ACC_BYTES / chunk_bytes));
+	double total = 0.5 * double(count) * double(count - (count > 0));
+
+	chunk_rows.assign(chunks + 1, count);
+	chunk_rows[0] = 0;
+	size_t c = 1;
+	for (uint32_t i = 0; i < count && c < chunks; i++){
+		double before = double(i) * count - 0.5 * double(i) * double(i + 1);
+		while (c < chunks && before >= total * double(c) / double(chunks)){
+			chunk_rows[c++] = i;
+		}
+	}
+}
+
+/*
+ * Same attraction through the quadtree. Each particle sums its own
+ * acceleration, so there is no symmetric update here. Walks through
+ * a clustered region cost far more than walks through empty space,
+ * so the particles go out in small ranges for the pool to balance.
+ */
+void Simulation::apply_long_range_barnes_hut(float dt){
+	tree.build(particles, &pool);
+
+	// The walk only reads positions, so velocities can be kicked in place
+	ParticleStore::Column vx = particles.vx();
+	ParticleStore::Column vy = particles.vy();
+	pool.parallel_for(0, particles.size(), WALK_GRAIN, [&](size_t first, size_t last){
+		for (size_t i = first; i < last; i++){
+			float ax, ay;
+			tree.acceleration(i, particles, ax, ay);
+			vx[i] += ax * dt;
+			vy[i] += ay * dt;
+		}
+	});
+}
+
+void Simulation::apply_long_range_multipole(float dt){
+	multipole.accelerations(particles, accel_x, accel_y, &pool);
+	kick(accel_x, accel_y, dt);
+}
+
+void Simulation::apply_long_range_mesh(float dt){
+	mesh.accelerations(particles, accel_x, accel_y, &pool);
+	kick(accel_x, accel_y, dt);
+}
+
+void Simulation::kick(const std::vector<float> &ax, const std::vector<float> &ay, float dt){
+	ParticleStore::Column vx = particles.vx();
+	ParticleStore::Column vy = particles.vy();
+	pool.parallel_for(0, particles.size(), STEP_GRAIN, [&](size_t first, size_t last){
+		for (size_t i = first; i < last; i++){
+			vx[i] += ax[i] * dt;
+			vy[i] += ay[i] * dt;
+		}
+	});
+}
+
+// Short-range correction for every pair inside DIST_LIMIT
+void Simulation::apply_short_range(float dt){
+	/*
+	 * The mesh replaces ATTR_STRENGTH / d^2 with a softened force inside
+	 * the cutoff, so under ParticleMesh close pairs get the full
+	 * repulsion and the mesh's part is taken back out.
+	 */
+	const bool mesh_solver = settings.solver == Solver::ParticleMesh;
+	const float strength = mesh_solver ? REP_STRENGTH : REP_STRENGTH - ATTR_STRENGTH;
+	const float mesh_inner = mesh_solver ? ATTR_STRENGTH * mesh.inner_force_over_dist() : 0.0f;
+
+	if (settings.neighbor_lists){
+		verlet.update(particles, &pool);
+	}
+
+	/*
+	 * Lists can be off, or dropped after outgrowing their memory
+	 * budget. A list pair writes to both particles, so owners are taken
+	 * by the row of cells they sat in when the lists were built: pairs
+	 * owned by one row only reach the rows beside it, so every third row
+	 * can run at once, in three rounds. As on the grid path, the order
+	 * each particle's forces are summed in is fixed by that schedule,
+	 * not by the thread count.
+	 */
+	if (settings.neighbor_lists && verlet.valid()){
+		const int rows = verlet.rows();
+		for (int phase = 0; phase < 3; phase++){
+			pool.parallel_for(0, size_t((rows - phase + 2) / 3), 1, [&](size_t first, size_t last){
+				for (size_t r = first; r < last; r++){
+					const int row = int(3 * r) + phase;
+					for (const uint32_t *i = verlet.row_begin(row); i < verlet.row_end(row); i++){
+						const uint32_t *end = verlet.neighbours_end(*i);
+						for (const uint32_t *j = verlet.neighbours_begin(*i); j < end; j++){
+							apply_short_range_pair(*i, *j, strength, mesh_inner, dt);
 						}
-
-						float fx = (dist_x / dist) * force;
-						float fy = (dist_y / dist) * force;
-
-						particles[i].vx += fx  * dt;
-						particles[i].vy += fy  * dt;
-						particles[j].vx -= fx  * dt;
-						particles[j].vy -= fy  * dt;
 					}
 				}
-			}
-
-			/*
-			 * ======================================
-			 * 3. UPDATE PARTICLE POSITION
-			 * ======================================
-			 */
-
-			for (Particle &p : particles){
-				p.x += p.vx * dt;
-				p.y += p.vy  * dt;
-
-				// 3. Bounce off walls
-				if (p.x >= 1.0f && p.vx > 0.0f){
-					p.x = 1.0f;
-					p.vx = -p.vx;
-				}
-				if (p.x <= -1.0f && p.vx < 0.0f){
-					p.x = -1.0f;
-					p.vx = -p.vx;
-				}
-				if (p.y >= 1.0f && p.vy > 0.0f){
-					p.y = 1.0f;
-					p.vy = -p.vy;
-				}
-				if (p.y <= -1.0f && p.vy < 0.0f){
-					p.y = -1.0f;
-					p.vy = -p.vy;
-				}
-			}
+			});
 		}
-
-		const std::vector<Particle> &get_particles() const{
-			return particles;
-		}
-
-		// Size of a Particle
-		const size_t get_particle_size() const{
-			return sizeof(Particle);
+	} else{
+		apply_short_range_grid(strength, mesh_inner, dt);
+	}
+}
+
+/*
+ * Cells are at least sqrt(DIST_LIMIT) wide so every pair inside the
+ * repulsion radius is found in the 3x3 block around a cell. Each cell
+ * pairs with itself and with 4 of its neighbours (right, and the three
+ * cells above) so every neighbouring pair of cells is visited once.
+ *
+ * Positions are copied out in cell order first, so the particles of
+ * a cell are one contiguous run that the pair kernel can load whole.
+ *
+ * A row of cells only writes forces into its own row and the one
+ * above, so the even rows can all run at once, and then the odd
+ * rows. The order each particle's forces are summed in is fixed by
+ * that schedule, not by the thread count.
+ */
+void Simulation::apply_short_range_grid(float strength, float mesh_inner, float dt){
+	grid.build(particles, &pool);
+
+	const int side = grid.cells_per_side();
+	const std::vector<uint32_t> &sorted = grid.sorted_indices();
+	const size_t count = particles.size();
+
+	ParticleStore::ConstColumn x = particles.x();
+	ParticleStore::ConstColumn y = particles.y();
+	pair_x.resize(count);
+	pair_y.resize(count);
+	pair_ax.resize(count);
+	pair_ay.resize(count);
+	pool.parallel_for(0, count, STEP_GRAIN, [&](size_t first, size_t last){
+		for (size_t k = first; k < last; k++){
+			pair_x[k] = x[sorted[k]];
+			pair_y[k] = y[sorted[k]];
+			pair_ax[k] = 0.0f;
+			pair_ay[k] = 0.0f;
 		}
+	});
 
-		// Size of particles vector
-		const size_t get_particles_count() const{
-			return particles.size();
+	const PairParams params{strength, 0.0f, DIST_LIMIT, MIN_DIST_SQR, mesh_inner};
+	for (int phase = 0; phase < 2; phase++){
+		pool.parallel_for(0, (side - phase + 1) / 2, 1, [&](size_t first, size_t last){
+			for (size_t r = first; r < last; r++){
+				apply_short_range_row(int(2 * r) + phase, params);
+			}
+		});
+	}
+
+	ParticleStore::Column vx = particles.vx();
+	ParticleStore::Column vy = particles.vy();
+	pool.parallel_for(0, count, STEP_GRAIN, [&](size_t first, size_t last){
+		for (size_t k = first; k < last; k++){
+			vx[sorted[k]] += pair_ax[k] * dt;
+			vy[sorted[k]] += pair_ay[k] * dt;
 		}
-
-		const Particle *get_particles_data() const{
-			return particles.data();
+	});
+}
+
+// Cell pairs whose first cell lies in row cy, on the cell-ordered arrays
+void Simulation::apply_short_range_row(int cy, const PairParams &params){
+	const int side = grid.cells_per_side();
+	const int offsets[4][2] = {{1, 0}, {-1, 1}, {0, 1}, {1, 1}};
+
+	for (int cx = 0; cx < side; cx++){
+		int c = cy * side + cx;
+		uint32_t begin = grid.cell_begin(c);
+		uint32_t end = grid.cell_end(c);
+
+		// Pairs within the cell
+		for (uint32_t a = begin; a < end; a++){
+			pair_kernel(pair_x.data(), pair_y.data(), pair_ax.data(), pair_ay.data(), a, a + 1, end, params);
 		}
 
-	private:
+		// Pairs with the forward neighbours
+		for (const auto &offset : offsets){
+			int nx = cx + offset[0];
+			int ny = cy + offset[1];
+			if (nx < 0 || nx >= side || ny >= side){
+				continue;
+			}
 
-		// set particles start point coordinates
-		void set_coordinates(){
-			for (Particle &p : particles){
-				p.x = dist(gen);
-				p.y = dist(gen);
+			int n = ny * side + nx;
+			uint32_t n_begin = grid.cell_begin(n);
+			uint32_t n_end = grid.cell_end(n);
+			if (n_begin == n_end){
+				continue;
+			}
 
-				p.vx = dist(gen);
-				p.vy = dist(gen);
+			for (uint32_t a = begin; a < end; a++){
+				pair_kernel(pair_x.data(), pair_y.data(), pair_ax.data(), pair_ay.data(), a, n_begin, n_end, params);
 			}
 		}
-
-		// Particle list settings
-		std::vector<Particle> particles;
-		std::random_device ran_dev;
-		std::mt19937 gen;
-		std::uniform_real_distribution<float> dist;
-
-		// Gravity settings
-		const float GRAVITY = 0.1f;
-
-		// Wind settings
-		const float WIND_X = 0.05f;
-		const float WIND_Y = 0.0f;
-		std::uniform_real_distribution<float> wind_noise;
-
-		// Attract to center settings
-		const float PULL_MULTIPLIER = 0.001f;
-
-		// Attraction & Repulsion settings
-		const float ATTR_STRENGTH = 0.0001f;
-		const float REP_STRENGTH = -0.001f;
-		const float DIST_LIMIT = 0.05f;
-};
+	}
+}
+
+void Simulation::apply_short_range_pair(uint32_t i, uint32_t j, float strength, float mesh_inner, float dt){
+	ParticleStore::ConstColumn x = particles.x();
+	ParticleStore::ConstColumn y = particles.y();
+	ParticleStore::Column vx = particles.vx();
+	ParticleStore::Column vy = particles.vy();
+
+	float dist_x = x[j] - x[i];
+	float dist_y = y[j] - y[i];
+
+	float dist_sqr = (dist_x * dist_x) + (dist_y * dist_y);
+	if (dist_sqr >= DIST_LIMIT){
+		return;
+	}
+
+	float fx = 0.0f;
+	float fy = 0.0f;
+	if (dist_sqr > MIN_DIST_SQR){ // avoid division by 0
+		float dist = sqrt(dist_sqr);
+		float force = strength / dist_sqr;
+
+		fx = (dist_x / dist) * force;
+		fy = (dist_y / dist) * force;
+	}
+
+	fx -= dist_x * mesh_inner;
+	fy -= dist_y * mesh_inner;
+
+	vx[i] += fx  * dt;
+	vy[i] += fy  * dt;
+	vx[j] -= fx  * dt;
+	vy[j] -= fy  * dt;
+}
+
+// Sort storage along the curve and carry the ids along
+void Simulation::reorder_particles(){
+	auto start = std::chrono::steady_clock::now();
+
+	sorter.sort(particles, settings.reorder_curve, order, &pool);
+
+	reordered.resize(particles.size());
+	reordered_ids.resize(particles.size());
+	const ParticleStore &from = particles;
+	gather(from.x(), reordered.x());
+	gather(from.y(), reordered.y());
+	gather(from.vx(), reordered.vx());
+	gather(from.vy(), reordered.vy());
+
+	// order is a permutation, so every task writes its own slots
+	pool.parallel_for(0, order.size(), STEP_GRAIN, [&](size_t first, size_t last){
+		for (size_t k = first; k < last; k++){
+			reordered_ids[k] = ids[order[k]];
+			slots[reordered_ids[k]] = static_cast<uint32_t>(k);
+		}
+	});
+	particles.swap(reordered);
+	ids.swap(reordered_ids);
+
+	// Lists hold storage indices, which have all changed
+	verlet.invalidate();
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	reorder_stats.reorders++;
+	reorder_stats.last_ms = elapsed.count();
+	reorder_stats.total_ms += elapsed.count();
+}
+
+void Simulation::gather(ParticleStore::ConstColumn from, ParticleStore::Column to){
+	pool.parallel_for(0, order.size(), STEP_GRAIN, [&](size_t first, size_t last){
+		for (size_t k = first; k < last; k++){
+			to[k] = from[order[k]];
+		}
+	});
+}
+
+// set particles start point coordinates
+void Simulation::set_coordinates(){
+	for (size_t i = 0; i < particles.size(); i++){
+		Particle p;
+		p.x = dist(gen);
+		p.y = dist(gen);
+
+		p.vx = dist(gen);
+		p.vy = dist(gen);
+		particles.set(i, p);
+	}
+}
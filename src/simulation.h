@@ -0,0 +1,277 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <vector>
+#include <random>
+#include <cstdint>
+#include <cstddef>
+
+#include "particle.h"
+#include "particle_store.h"
+#include "cell_grid.h"
+#include "barnes_hut.h"
+#include "fast_multipole.h"
+#include "particle_mesh.h"
+#include "verlet_list.h"
+#include "curve_sorter.h"
+#include "pair_kernel.h"
+#include "integrate_kernel.h"
+#include "philox.h"
+#include "quantize_kernel.h"
+#include "thread_pool.h"
+#include "simulation_settings.h"
+
+/*
+ * The simulation engine, built once into the dretsim_core library. The GL
+ * viewer, the headless runner and anything else that drives the engine
+ * include this header and link the library.
+ */
+class Simulation{
+
+	public:
+		// count particles at random positions and velocities, drawn from the seed
+		Simulation(int count, SimulationSettings settings = SimulationSettings());
+
+		// Starts from state instead, where state[id] becomes particle id
+		Simulation(const std::vector<Particle> &state, SimulationSettings settings = SimulationSettings());
+
+		// update particles position
+		void update_particles(float dt);
+
+		/*
+		 * Particles are stored as separate x / y / vx / vy arrays, or as
+		 * blocks of them when built with DRETSIM_AOSOA_WIDTH. The
+		 * array-of-structs getters below interleave them into a copy that is
+		 * refreshed on every call, for callers such as the OpenGL upload that
+		 * want one Particle per vertex.
+		 */
+		const std::vector<Particle> &get_particles() const{
+			particles_aos.resize(particles.size());
+			particles.export_particles(particles_aos.data());
+			return particles_aos;
+		}
+
+		// Interleave straight into a caller's buffer of get_particles_count() particles
+		void export_particles(Particle *out) const{
+			particles.export_particles(out);
+		}
+
+		const ParticleStore &get_particle_store() const{
+			return particles;
+		}
+
+		// Size of a Particle
+		const size_t get_particle_size() const{
+			return sizeof(Particle);
+		}
+
+		// Size of particles vector
+		const size_t get_particles_count() const{
+			return particles.size();
+		}
+
+		const Particle *get_particles_data() const{
+			return get_particles().data();
+		}
+
+		// Verlet list rebuilds and reuses so far, for tuning the skin
+		const VerletListStats &get_neighbor_list_stats() const{
+			return verlet.get_stats();
+		}
+
+		/*
+		 * Reordering moves particles around in storage, so each one keeps a
+		 * stable id: get_particle_ids()[slot] is the id of the particle stored
+		 * at slot, and get_particle_slot(id) is where that particle is now.
+		 */
+		const std::vector<uint32_t> &get_particle_ids() const{
+			return ids;
+		}
+
+		uint32_t get_particle_slot(uint32_t id) const{
+			return slots[id];
+		}
+
+		Particle get_particle(uint32_t id) const{
+			return particles.get(slots[id]);
+		}
+
+		// Interleave into out[id], so every particle keeps its place however storage is ordered
+		void export_particles_by_id(Particle *out) const;
+
+		/*
+		 * Positions only, in id order, packed for rendering as 16-bit
+		 * integers: out[2 * id] and out[2 * id + 1] hold x and y scaled by
+		 * QUANTIZE_SCALE.
+		 */
+		void export_positions_by_id(int16_t *out) const;
+
+		const ReorderStats &get_reorder_stats() const{
+			return reorder_stats;
+		}
+
+		// Where the last tick's time went
+		const PhaseTimes &get_phase_times() const{
+			return phase_times;
+		}
+
+		/*
+		 * Hardware counts per phase with settings.perf_counters, all zero
+		 * when get_perf_counters() is not open; its error() says why.
+		 */
+		const PhaseCounterTotals &get_phase_counters() const{
+			return phase_counters;
+		}
+
+		void reset_phase_counters(){
+			phase_counters = PhaseCounterTotals();
+		}
+
+		const PerfCounters &get_perf_counters() const{
+			return counters;
+		}
+
+		// Ticks run so far
+		size_t get_tick() const{
+			return tick;
+		}
+
+		uint64_t get_seed() const{
+			return seed;
+		}
+
+		size_t get_thread_count() const{
+			return pool.size();
+		}
+
+		// Instruction set the kernels were dispatched to
+		SimdLevel get_simd_level() const{
+			return simd_level;
+		}
+
+		const SimulationSettings &get_settings() const{
+			return settings;
+		}
+
+		/*
+		 * Settings that may change between ticks, so a caller can trade
+		 * accuracy for speed while running. The rest are fixed once the
+		 * simulation is built.
+		 */
+		void set_solver(Solver solver){
+			settings.solver = solver;
+		}
+
+		void set_theta(float theta){
+			settings.theta = theta;
+			tree.set_theta(theta);
+		}
+
+	private:
+		Simulation(size_t count, const Particle *state, const SimulationSettings &settings);
+
+		void apply_direct(float dt);
+		void split_direct_rows(uint32_t count);
+		void apply_long_range_barnes_hut(float dt);
+		void apply_long_range_multipole(float dt);
+		void apply_long_range_mesh(float dt);
+		void kick(const std::vector<float> &ax, const std::vector<float> &ay, float dt);
+		void apply_short_range(float dt);
+		void apply_short_range_grid(float strength, float mesh_inner, float dt);
+		void apply_short_range_row(int cy, const PairParams &params);
+		void apply_short_range_pair(uint32_t i, uint32_t j, float strength, float mesh_inner, float dt);
+		void reorder_particles();
+		void gather(ParticleStore::ConstColumn from, ParticleStore::Column to);
+		void set_coordinates();
+
+		// Particle list settings
+		ParticleStore particles;
+		SimulationSettings settings;
+
+		// Interleaved copy handed out by get_particles()
+		mutable std::vector<Particle> particles_aos;
+		std::random_device ran_dev;
+		uint64_t seed;
+		std::mt19937 gen;
+		std::uniform_real_distribution<float> dist;
+
+		// Gravity settings
+		const float GRAVITY = 0.1f;
+
+		// Wind settings
+		const float WIND_X = 0.05f;
+		const float WIND_Y = 0.0f;
+		const float WIND_NOISE = 0.01f;
+		const uint32_t WIND_STREAM = 0;
+
+		// Attract to center settings
+		const float PULL_MULTIPLIER = 0.001f;
+
+		// Attraction & Repulsion settings
+		const float ATTR_STRENGTH = 0.0001f;
+		const float REP_STRENGTH = -0.001f;
+		const float DIST_LIMIT = 0.05f;
+		const float MIN_DIST_SQR = 0.0001f;
+
+		// Short-range neighbour search
+		CellGrid grid;
+
+		// Long-range solvers
+		BarnesHut tree;
+		FastMultipole multipole;
+		ParticleMesh mesh;
+
+		VerletList verlet;
+
+		// Space-filling-curve reordering and the stable id indirection
+		CurveSorter sorter;
+		std::vector<uint32_t> order;
+		ParticleStore reordered;
+		std::vector<uint32_t> reordered_ids;
+		std::vector<uint32_t> ids;
+		std::vector<uint32_t> slots;
+		ReorderStats reorder_stats;
+		PhaseTimes phase_times;
+		size_t tick = 0;
+
+		// Kernels picked for this CPU, and plain-array scratch for them
+		SimdLevel simd_level;
+		PairRowKernel pair_kernel;
+		StepKernel step_kernel;
+		NoiseKernel noise_kernel;
+		QuantizeKernel quantize_kernel;
+		ParticleStore::Array noise_x;
+		ParticleStore::Array noise_y;
+		ParticleStore::Array pair_x;
+		ParticleStore::Array pair_y;
+		ParticleStore::Array pair_ax;
+		ParticleStore::Array pair_ay;
+		mutable ParticleStore::Array render_x;
+		mutable ParticleStore::Array render_y;
+
+		/*
+		 * Direct solver: per-chunk force accumulators and the rows each
+		 * chunk owns. Every chunk holds two floats per particle, so fewer
+		 * chunks are cut once they would outgrow DIRECT_ACC_BYTES.
+		 */
+		ParticleStore::Array pair_acc;
+		std::vector<uint32_t> chunk_rows;
+		static const uint32_t DIRECT_CHUNK_ROWS = 64;
+		static const size_t MAX_DIRECT_CHUNKS = 64;
+		static const size_t DIRECT_ACC_BYTES = size_t(32) << 20;
+		static const size_t REDUCE_SLICE = 4096;
+
+		std::vector<float> accel_x;
+		std::vector<float> accel_y;
+
+		// Opened before the pool starts its workers, so the workers are counted too
+		PerfCounters counters;
+		PhaseCounterTotals phase_counters;
+
+		// Runs every phase; the work per task is about STEP_GRAIN particles, WALK_GRAIN for tree walks
+		ThreadPool pool;
+		static const size_t STEP_GRAIN = 4096;
+		static const size_t WALK_GRAIN = 256;
+};
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef SIMULATION_SETTINGS_H
+#define SIMULATION_SETTINGS_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include "curve_sorter.h"
+#include "simd_level.h"
+#include "perf_counters.h"
+
+// How the long-range attraction between particles is computed
+enum class Solver{
+	Direct,		// exact all-pairs sum, the reference solver
+	BarnesHut,	// quadtree approximation, O(n log n)
+	FastMultipole,	// multipole expansions, O(n)
+	ParticleMesh	// FFT on a fixed mesh plus a short-range correction, P3M
+};
+
+struct SimulationSettings{
+	Solver solver = Solver::Direct;
+
+	// Barnes-Hut opening angle: smaller is more accurate and slower
+	float theta = 0.5f;
+
+	// Fast multipole expansion order: the error falls geometrically with it
+	int fmm_order = 6;
+
+	// Particle-mesh cells per side, rounded up to a power of two
+	int mesh_size = 128;
+
+	/*
+	 * Take short-range pairs from Verlet lists that are rebuilt once some
+	 * particle has moved half the skin, instead of walking the cell grid
+	 * every tick. A wider skin means fewer rebuilds but longer lists. They
+	 * only pay off once velocities are small next to skin / 2 per tick.
+	 */
+	bool neighbor_lists = false;
+	float verlet_skin = 0.02f;
+
+	/*
+	 * Every reorder_interval ticks the particle storage is sorted along a
+	 * space-filling curve so neighbours in space are neighbours in memory.
+	 * 0 turns reordering off.
+	 */
+	int reorder_interval = 0;
+	Curve reorder_curve = Curve::Hilbert;
+
+	/*
+	 * Cap on the vector instruction set used by the pair and integration
+	 * kernels. The widest one the CPU supports up to this cap is picked at
+	 * startup.
+	 */
+	SimdLevel max_simd = SimdLevel::Avx512;
+
+	/*
+	 * Seeds the starting positions and the wind noise, so two runs with the
+	 * same seed and settings match. 0 draws a fresh seed from
+	 * std::random_device; get_seed() reports the one in use.
+	 */
+	uint64_t seed = 0;
+
+	// Threads that run the simulation phases, 0 for one per hardware thread
+	int threads = 0;
+
+	/*
+	 * Count cycles, instructions, cache and branch misses per phase with
+	 * perf_event_open. Needs a build with DRETSIM_PERF_COUNTERS; costs a
+	 * few system calls per phase.
+	 */
+	bool perf_counters = false;
+};
+
+struct ReorderStats{
+	size_t reorders = 0;
+	double last_ms = 0.0;	// cost of the most recent reorder
+	double total_ms = 0.0;
+};
+
+/*
+ * Wall time each phase of the last tick took. Under Solver::Direct the
+ * whole pair sum counts as long range. The step fuses the external forces,
+ * the position update and the wall bounce into one pass, so they are
+ * timed together.
+ */
+struct PhaseTimes{
+	double reorder_ms = 0.0;	// 0 on ticks that do not reorder
+	double long_range_ms = 0.0;
+	double short_range_ms = 0.0;
+	double step_ms = 0.0;
+};
+
+// Hardware counts per phase, summed since the start or the last reset
+struct PhaseCounterTotals{
+	PhaseCounters reorder;
+	PhaseCounters long_range;
+	PhaseCounters short_range;
+	PhaseCounters step;
+};
+
+#endif
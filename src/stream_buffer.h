@@ -0,0 +1,166 @@
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <cstring>
+
+/*
+ * Vertex buffer for data rewritten every frame.
+ *
+ * Where the driver has buffer storage (GL 4.4 or ARB_buffer_storage), the
+ * buffer is allocated once with room for REGIONS copies of the data, and
+ * mapped once, persistently and coherently, for the life of the buffer.
+ * Each frame writes the next region straight through the mapping while the
+ * GPU may still be drawing from the other two; a fence placed after the
+ * draws that read a region tells when it can be written again. There is
+ * no copy inside the driver and no implicit sync.
+ *
+ * Without buffer storage it falls back to GL 3.3 orphaning: every write
+ * re-specifies a single region, so the driver hands back fresh memory
+ * instead of waiting for draws of the old contents, then maps it with the
+ * old contents invalidated.
+ *
+ * Usage per frame: map_next(), fill the memory, unmap() for the byte offset
+ * of the region to draw from, draw, then fence().
+ */
+class StreamBuffer{
+
+	public:
+		static const int REGIONS = 3;
+
+		/*
+		 * Creates the buffer and binds it to GL_ARRAY_BUFFER. load resolves
+		 * glBufferStorage, which the 3.3 loader does not know about.
+		 */
+		StreamBuffer(size_t region_bytes, GLADloadproc load): region_bytes(region_bytes){
+			glGenBuffers(1, &buffer);
+			glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+			BufferStorageProc buffer_storage = nullptr;
+			if (has_buffer_storage()){
+				buffer_storage = reinterpret_cast<BufferStorageProc>(load("glBufferStorage"));
+			}
+
+			if (buffer_storage){
+				const GLbitfield flags = GL_MAP_WRITE_BIT | MAP_PERSISTENT_BIT | MAP_COHERENT_BIT;
+				buffer_storage(GL_ARRAY_BUFFER, REGIONS * region_bytes, nullptr, flags);
+				mapped = static_cast<char *>(glMapBufferRange(GL_ARRAY_BUFFER, 0, REGIONS * region_bytes, flags));
+			}
+			if (!mapped){
+				glBufferData(GL_ARRAY_BUFFER, region_bytes, nullptr, GL_STREAM_DRAW);
+			}
+		}
+
+		~StreamBuffer(){
+			for (GLsync &fence : fences){
+				if (fence){
+					glDeleteSync(fence);
+				}
+			}
+			if (mapped){
+				glBindBuffer(GL_ARRAY_BUFFER, buffer);
+				glUnmapBuffer(GL_ARRAY_BUFFER);
+			}
+			glDeleteBuffers(1, &buffer);
+		}
+
+		StreamBuffer(const StreamBuffer &) = delete;
+		StreamBuffer &operator=(const StreamBuffer &) = delete;
+
+		unsigned int id() const{
+			return buffer;
+		}
+
+		// Whether the persistent path is in use
+		bool persistent() const{
+			return mapped != nullptr;
+		}
+
+		/*
+		 * Write access to the next region's region_bytes bytes, once the
+		 * GPU has finished the draws that read it. Leaves the buffer bound
+		 * to GL_ARRAY_BUFFER.
+		 */
+		void *map_next(){
+			glBindBuffer(GL_ARRAY_BUFFER, buffer);
+			if (!mapped){
+				glBufferData(GL_ARRAY_BUFFER, region_bytes, nullptr, GL_STREAM_DRAW);
+				return glMapBufferRange(GL_ARRAY_BUFFER, 0, region_bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+			}
+
+			current = (current + 1) % REGIONS;
+			wait(current);
+			return mapped + current * region_bytes;
+		}
+
+		// Ends the write and returns where the region starts in the buffer
+		size_t unmap(){
+			if (!mapped){
+				glUnmapBuffer(GL_ARRAY_BUFFER);
+				return 0;
+			}
+			return current * region_bytes;
+		}
+
+		// Call after the draws that read the current region, every frame they are issued
+		void fence(){
+			if (!mapped){
+				return;
+			}
+			if (fences[current]){
+				glDeleteSync(fences[current]);
+			}
+			fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		}
+
+	private:
+		using BufferStorageProc = void (APIENTRYP)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+
+		// GL 4.4 tokens the 3.3 header does not define
+		static const GLbitfield MAP_PERSISTENT_BIT = 0x0040;
+		static const GLbitfield MAP_COHERENT_BIT = 0x0080;
+
+		// Blocks until the draws fenced on a region are done; the first wait flushes them
+		void wait(int region){
+			GLsync &fence = fences[region];
+			if (!fence){
+				return;
+			}
+			GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+			while (true){
+				GLenum status = glClientWaitSync(fence, flags, WAIT_TIMEOUT_NS);
+				if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED || status == GL_WAIT_FAILED){
+					break;
+				}
+				flags = 0;
+			}
+			glDeleteSync(fence);
+			fence = nullptr;
+		}
+
+		static bool has_buffer_storage(){
+			if (GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 4)){
+				return true;
+			}
+			GLint extensions = 0;
+			glGetIntegerv(GL_NUM_EXTENSIONS, &extensions);
+			for (GLint e = 0; e < extensions; e++){
+				const char *name = reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, e));
+				if (name && std::strcmp(name, "GL_ARB_buffer_storage") == 0){
+					return true;
+				}
+			}
+			return false;
+		}
+
+		static const GLuint64 WAIT_TIMEOUT_NS = 1000000;
+
+		size_t region_bytes;
+		unsigned int buffer = 0;
+		char *mapped = nullptr;
+		int current = 0;
+		GLsync fences[REGIONS] = {};
+};
+
+#endif
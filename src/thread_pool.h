@@ -0,0 +1,304 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <cstddef>
+
+class TaskGroup;
+
+/*
+ * Work-stealing thread pool.
+ *
+ * Every worker owns a deque of tasks. A worker pushes and pops at the back
+ * of its own deque, so it keeps working on the most recently split, and
+ * therefore smallest and cache-warm, piece. When its deque is empty it
+ * steals from the front of another worker's deque, which holds the oldest
+ * and largest pieces. Clustered particles leave some ranges far more
+ * expensive than others, and stealing rebalances that without any up-front
+ * partitioning.
+ *
+ * The pool runs `threads - 1` worker threads. A thread outside the pool
+ * that waits on a TaskGroup works through slot 0, so the caller is the
+ * last worker rather than sitting idle. Idle workers spin briefly and then
+ * sleep until new tasks are pushed.
+ *
+ * Each deque has its own small mutex. Only the owner and an occasional
+ * thief ever contend for it, and a task is a range of work rather than a
+ * single particle, so the lock is cheap next to the task.
+ */
+class ThreadPool{
+
+	public:
+		explicit ThreadPool(size_t threads){
+			if (threads < 1){
+				threads = 1;
+			}
+			for (size_t w = 0; w < threads; w++){
+				workers.emplace_back(new Worker());
+			}
+			for (size_t w = 1; w < threads; w++){
+				helpers.emplace_back([this, w]{ worker_loop(w); });
+			}
+		}
+
+		~ThreadPool(){
+			{
+				std::lock_guard<std::mutex> lock(sleep_lock);
+				stopping = true;
+			}
+			wake.notify_all();
+			for (std::thread &helper : helpers){
+				helper.join();
+			}
+		}
+
+		ThreadPool(const ThreadPool &) = delete;
+		ThreadPool &operator=(const ThreadPool &) = delete;
+
+		// Threads that run tasks, counting the caller
+		size_t size() const{
+			return workers.size();
+		}
+
+		/*
+		 * Calls body(b, e) over subranges covering [begin, end) and returns
+		 * once all of them are done. Ranges are split in half until they
+		 * are at most grain long; one half is pushed for others to steal
+		 * and the other is split further, so the first thief takes half the
+		 * work in one go.
+		 */
+		template <typename Body>
+		void parallel_for(size_t begin, size_t end, size_t grain, const Body &body);
+
+	private:
+		friend class TaskGroup;
+
+		struct Task{
+			void (*invoke)(const void *context, size_t begin, size_t end);
+			const void *context;
+			size_t begin;
+			size_t end;
+			TaskGroup *group;
+		};
+
+		// Own cache line each, so workers never share one through their deques
+		struct alignas(64) Worker{
+			std::mutex lock;
+			std::deque<Task> tasks;
+		};
+
+		// Index of the calling thread's deque: its own for pool threads, 0 otherwise
+		size_t current_index() const{
+			return current_pool == this ? current_worker : 0;
+		}
+
+		void push(const Task &task){
+			Worker &worker = *workers[current_index()];
+			{
+				std::lock_guard<std::mutex> lock(worker.lock);
+				worker.tasks.push_back(task);
+			}
+			if (queued.fetch_add(1) == 0 || sleepers.load() > 0){
+				// Taking the lock orders this push before a worker's check for work
+				{
+					std::lock_guard<std::mutex> lock(sleep_lock);
+				}
+				wake.notify_one();
+			}
+		}
+
+		bool pop(size_t index, Task &task){
+			{
+				Worker &own = *workers[index];
+				std::lock_guard<std::mutex> lock(own.lock);
+				if (!own.tasks.empty()){
+					task = own.tasks.back();
+					own.tasks.pop_back();
+					queued.fetch_sub(1);
+					return true;
+				}
+			}
+
+			for (size_t k = 1; k < workers.size(); k++){
+				Worker &victim = *workers[(index + k) % workers.size()];
+				std::lock_guard<std::mutex> lock(victim.lock);
+				if (!victim.tasks.empty()){
+					task = victim.tasks.front();
+					victim.tasks.pop_front();
+					queued.fetch_sub(1);
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// Runs one queued task if there is one
+		bool run_one(size_t index);
+
+		void worker_loop(size_t index){
+			current_pool = this;
+			current_worker = index;
+
+			while (true){
+				if (run_one(index)){
+					continue;
+				}
+
+				bool found = false;
+				for (int spin = 0; spin < SPIN_ROUNDS && !found; spin++){
+					std::this_thread::yield();
+					found = queued.load() > 0 || stopping;
+				}
+				if (found){
+					if (stopping){
+						return;
+					}
+					continue;
+				}
+
+				std::unique_lock<std::mutex> lock(sleep_lock);
+				sleepers++;
+				wake.wait(lock, [this]{ return queued.load() > 0 || stopping; });
+				sleepers--;
+				if (stopping){
+					return;
+				}
+			}
+		}
+
+		template <typename Body>
+		struct ForContext{
+			const Body *body;
+			size_t grain;
+			TaskGroup *group;
+		};
+
+		template <typename Body>
+		static void run_range(const void *context, size_t begin, size_t end);
+
+		static const int SPIN_ROUNDS = 2000;
+
+		std::vector<std::unique_ptr<Worker>> workers;
+		std::vector<std::thread> helpers;
+
+		std::atomic<size_t> queued{0};
+		std::atomic<int> sleepers{0};
+		std::atomic<bool> stopping{false};
+		std::mutex sleep_lock;
+		std::condition_variable wake;
+
+		static thread_local ThreadPool *current_pool;
+		static thread_local size_t current_worker;
+};
+
+inline thread_local ThreadPool *ThreadPool::current_pool = nullptr;
+inline thread_local size_t ThreadPool::current_worker = 0;
+
+/*
+ * Fork-join: run() hands a task to the pool, wait() returns once every task
+ * handed over so far has finished. The waiting thread runs queued tasks,
+ * its own or stolen, while it waits, so nesting groups inside tasks never
+ * leaves a thread blocked.
+ *
+ * run() keeps a pointer to the callable, so it must outlive wait().
+ */
+class TaskGroup{
+
+	public:
+		explicit TaskGroup(ThreadPool &pool): pool(pool){}
+
+		~TaskGroup(){
+			wait();
+		}
+
+		TaskGroup(const TaskGroup &) = delete;
+		TaskGroup &operator=(const TaskGroup &) = delete;
+
+		template <typename F>
+		void run(const F &task){
+			spawn(&invoke<F>, &task, 0, 0);
+		}
+
+		void wait(){
+			const size_t index = pool.current_index();
+			while (pending.load(std::memory_order_acquire) > 0){
+				if (!pool.run_one(index)){
+					std::this_thread::yield();
+				}
+			}
+		}
+
+	private:
+		friend class ThreadPool;
+
+		template <typename F>
+		static void invoke(const void *task, size_t, size_t){
+			(*static_cast<const F *>(task))();
+		}
+
+		void spawn(void (*fn)(const void *, size_t, size_t), const void *context, size_t begin, size_t end){
+			pending.fetch_add(1, std::memory_order_relaxed);
+			pool.push(ThreadPool::Task{fn, context, begin, end, this});
+		}
+
+		ThreadPool &pool;
+		std::atomic<size_t> pending{0};
+};
+
+inline bool ThreadPool::run_one(size_t index){
+	Task task;
+	if (!pop(index, task)){
+		return false;
+	}
+	task.invoke(task.context, task.begin, task.end);
+	task.group->pending.fetch_sub(1, std::memory_order_release);
+	return true;
+}
+
+template <typename Body>
+void ThreadPool::run_range(const void *context, size_t begin, size_t end){
+	const ForContext<Body> &c = *static_cast<const ForContext<Body> *>(context);
+	while (end - begin > c.grain){
+		size_t mid = begin + (end - begin) / 2;
+		c.group->spawn(&run_range<Body>, context, mid, end);
+		end = mid;
+	}
+	(*c.body)(begin, end);
+}
+
+template <typename Body>
+void ThreadPool::parallel_for(size_t begin, size_t end, size_t grain, const Body &body){
+	if (grain < 1){
+		grain = 1;
+	}
+	if (end <= begin){
+		return;
+	}
+	if (end - begin <= grain || workers.size() == 1){
+		body(begin, end);
+		return;
+	}
+
+	TaskGroup group(*this);
+	const ForContext<Body> context{&body, grain, &group};
+	run_range<Body>(&context, begin, end);
+	group.wait();
+}
+
+// parallel_for on the pool, or straight through on the calling thread without one
+template <typename Body>
+void parallel_for(ThreadPool *pool, size_t begin, size_t end, size_t grain, const Body &body){
+	if (pool){
+		pool->parallel_for(begin, end, grain, body);
+	} else if (begin < end){
+		body(begin, end);
+	}
+}
+
+#endif
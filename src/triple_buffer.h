@@ -0,0 +1,79 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+/*
+ * Lock-free triple buffer for handing whole states from one writer thread
+ * to one reader thread.
+ *
+ * Of the three slots, the writer owns one (back), the reader owns one
+ * (front) and the third (middle) holds the most recently published state.
+ * Publishing swaps back and middle, reading swaps middle and front, each
+ * with a single atomic exchange, so neither side ever waits for the
+ * other. The writer can publish any number of times between two reads;
+ * the reader then just sees the newest one and the rest are overwritten.
+ *
+ * The middle index carries a fresh bit, set by publish() and cleared by
+ * the read, so the reader knows whether there is anything new to take.
+ */
+template <typename T>
+class TripleBuffer{
+
+	public:
+		TripleBuffer(): middle(1){}
+
+		TripleBuffer(const TripleBuffer &) = delete;
+		TripleBuffer &operator=(const TripleBuffer &) = delete;
+
+		// Writer: the slot to fill before the next publish()
+		T &write_buffer(){
+			return slots[back];
+		}
+
+		// Writer: make the filled slot the newest state and take the old middle back
+		void publish(){
+			uint8_t old = middle.exchange(back | FRESH, std::memory_order_acq_rel);
+			back = old & INDEX;
+		}
+
+		/*
+		 * Reader: take the newest published state if there is one since the
+		 * last call. Returns false, and leaves read_buffer() as it was, if
+		 * nothing new has been published.
+		 */
+		bool update(){
+			if (!(middle.load(std::memory_order_relaxed) & FRESH)){
+				return false;
+			}
+			uint8_t old = middle.exchange(front, std::memory_order_acq_rel);
+			front = old & INDEX;
+			return true;
+		}
+
+		// Reader: the state taken by the last successful update()
+		const T &read_buffer() const{
+			return slots[front];
+		}
+
+		// Either side, before the other thread starts: fill every slot with the same state
+		void fill(const T &value){
+			for (T &slot : slots){
+				slot = value;
+			}
+		}
+
+	private:
+		static const uint8_t INDEX = 0x3;
+		static const uint8_t FRESH = 0x4;
+
+		T slots[3];
+
+		// Each index on its own cache line, so the two threads never share one
+		alignas(64) uint8_t back = 0;
+		alignas(64) std::atomic<uint8_t> middle;
+		alignas(64) uint8_t front = 2;
+};
+
+#endif
@@ -0,0 +1,267 @@
+#ifndef VERLET_LIST_H
+#define VERLET_LIST_H
+
+#include <vector>
+#include <cstdint>
+#include <atomic>
+#include <algorithm>
+
+#include "particle_store.h"
+#include "cell_grid.h"
+#include "thread_pool.h"
+
+struct VerletListStats{
+	size_t builds = 0;		// ticks that rebuilt the lists
+	size_t reuses = 0;		// ticks that reused the previous lists
+	size_t pairs = 0;		// pairs in the current lists
+	bool overflowed = false;	// lists outgrew MAX_ENTRIES and were dropped
+};
+
+/*
+ * Per-particle neighbour lists with a skin.
+ *
+ * Every pair closer than cutoff + skin is recorded once, under the lower
+ * index, using a cell grid as wide as cutoff + skin. The lists stay valid
+ * until some particle has moved more than skin / 2 since the build: until
+ * then no pair outside the lists can have come inside the cutoff.
+ *
+ * Lists cost memory proportional to the number of pairs in range, which
+ * grows with density. If a build would pass MAX_ENTRIES it is abandoned,
+ * the stats record the overflow, and valid() stays false so the caller
+ * falls back to its own neighbour search.
+ *
+ * With a pool, the displacement check and the build run in parallel: the
+ * build lists fixed ranges of particles separately and then joins them in
+ * order, so the lists are the same as a serial build's.
+ */
+class VerletList{
+
+	public:
+		VerletList(float cutoff, float skin):
+			grid(cutoff + skin),
+			range_sqr((cutoff + skin) * (cutoff + skin)),
+			trigger_sqr(0.25f * skin * skin)
+		{}
+
+		/*
+		 * Rebuilds the lists if any particle has moved more than half the
+		 * skin since the last build, or if they were never built.
+		 */
+		void update(const ParticleStore &particles, ThreadPool *pool = nullptr){
+			if (stats.overflowed){
+				return;
+			}
+
+			if (built && ref_x.size() == particles.size() && !moved_past_trigger(particles, pool)){
+				stats.reuses++;
+				return;
+			}
+
+			build(particles, pool);
+		}
+
+		// Force a rebuild on the next update, e.g. after particles are reordered
+		void invalidate(){
+			built = false;
+		}
+
+		bool valid() const{
+			return built && !stats.overflowed;
+		}
+
+		// Neighbours of particle i, all with a higher index than i
+		const uint32_t *neighbours_begin(size_t i) const{
+			return neighbours.data() + offsets[i];
+		}
+
+		const uint32_t *neighbours_end(size_t i) const{
+			return neighbours.data() + offsets[i + 1];
+		}
+
+		const VerletListStats &get_stats() const{
+			return stats;
+		}
+
+		/*
+		 * Particles grouped by the row of cells they sat in at the last
+		 * build. A list only holds particles from the cells around its
+		 * owner's, so pairs owned by row r only touch particles of rows
+		 * r - 1 to r + 1, and rows three apart never touch the same one.
+		 */
+		int rows() const{
+			return grid.cells_per_side();
+		}
+
+		const uint32_t *row_begin(int row) const{
+			return grid.sorted_indices().data() + grid.cell_begin(row * grid.cells_per_side());
+		}
+
+		const uint32_t *row_end(int row) const{
+			return grid.sorted_indices().data() + grid.cell_end((row + 1) * grid.cells_per_side() - 1);
+		}
+
+	private:
+
+		bool moved_past_trigger(const ParticleStore &particles, ThreadPool *pool) const{
+			ParticleStore::ConstColumn x = particles.x();
+			ParticleStore::ConstColumn y = particles.y();
+			std::atomic<bool> moved{false};
+			parallel_for(pool, 0, particles.size(), CHECK_GRAIN, [&](size_t first, size_t last){
+				if (moved.load(std::memory_order_relaxed)){
+					return;
+				}
+				for (size_t i = first; i < last; i++){
+					float dx = x[i] - ref_x[i];
+					float dy = y[i] - ref_y[i];
+					if ((dx * dx) + (dy * dy) > trigger_sqr){
+						moved.store(true, std::memory_order_relaxed);
+						return;
+					}
+				}
+			});
+			return moved.load();
+		}
+
+		/*
+		 * Each range of BUILD_ROWS particles fills a list of its own, with
+		 * offsets counted from the start of that list. Ranges add what
+		 * they hold to a shared total every FLUSH_ENTRIES entries, so a
+		 * build that passes MAX_ENTRIES stops early wherever it overflows.
+		 */
+		void build(const ParticleStore &particles, ThreadPool *pool){
+			const size_t count = particles.size();
+			ParticleStore::ConstColumn px = particles.x();
+			ParticleStore::ConstColumn py = particles.y();
+
+			grid.build(particles, pool);
+			const int side = grid.cells_per_side();
+			const std::vector<uint32_t> &sorted = grid.sorted_indices();
+
+			const size_t ranges = (count + BUILD_ROWS - 1) / BUILD_ROWS;
+			offsets.resize(count + 1);
+			if (range_lists.size() < ranges){
+				range_lists.resize(ranges);
+			}
+			range_base.resize(ranges + 1);
+
+			std::atomic<size_t> total{0};
+			std::atomic<bool> overflow{false};
+			parallel_for(pool, 0, ranges, 1, [&](size_t first, size_t last){
+				for (size_t r = first; r < last && !overflow.load(std::memory_order_relaxed); r++){
+					std::vector<uint32_t> &list = range_lists[r];
+					list.clear();
+					size_t flushed = 0;
+
+					const size_t end = std::min(count, (r + 1) * BUILD_ROWS);
+					for (size_t i = r * BUILD_ROWS; i < end; i++){
+						offsets[i] = list.size();
+
+						const float x = px[i];
+						const float y = py[i];
+						const int cx = grid.cell_coord(x);
+						const int cy = grid.cell_coord(y);
+
+						for (int ny = std::max(cy - 1, 0); ny <= std::min(cy + 1, side - 1); ny++){
+							for (int nx = std::max(cx - 1, 0); nx <= std::min(cx + 1, side - 1); nx++){
+								int c = ny * side + nx;
+								for (uint32_t k = grid.cell_begin(c); k < grid.cell_end(c); k++){
+									uint32_t j = sorted[k];
+									if (j <= i){
+										continue;
+									}
+
+									float dist_x = px[j] - x;
+									float dist_y = py[j] - y;
+									if ((dist_x * dist_x) + (dist_y * dist_y) < range_sqr){
+										list.push_back(j);
+									}
+								}
+							}
+						}
+
+						if (list.size() - flushed >= FLUSH_ENTRIES || i + 1 == end){
+							size_t held = total.fetch_add(list.size() - flushed) + list.size() - flushed;
+							flushed = list.size();
+							if (held > MAX_ENTRIES){
+								overflow.store(true, std::memory_order_relaxed);
+							}
+						}
+						if (overflow.load(std::memory_order_relaxed)){
+							break;
+						}
+					}
+				}
+			});
+
+			if (overflow.load()){
+				stats.overflowed = true;
+				built = false;
+				neighbours.clear();
+				neighbours.shrink_to_fit();
+				range_lists.clear();
+				range_lists.shrink_to_fit();
+				return;
+			}
+
+			// Join the lists in range order and shift their offsets to where they landed
+			range_base[0] = 0;
+			for (size_t r = 0; r < ranges; r++){
+				range_base[r + 1] = range_base[r] + range_lists[r].size();
+			}
+			neighbours.resize(range_base[ranges]);
+			parallel_for(pool, 0, ranges, 1, [&](size_t first, size_t last){
+				for (size_t r = first; r < last; r++){
+					std::copy(range_lists[r].begin(), range_lists[r].end(), neighbours.begin() + range_base[r]);
+					const size_t end = std::min(count, (r + 1) * BUILD_ROWS);
+					for (size_t i = r * BUILD_ROWS; i < end; i++){
+						offsets[i] += range_base[r];
+					}
+				}
+			});
+			offsets[count] = neighbours.size();
+
+			ref_x.resize(count);
+			ref_y.resize(count);
+			parallel_for(pool, 0, count, CHECK_GRAIN, [&](size_t first, size_t last){
+				for (size_t i = first; i < last; i++){
+					ref_x[i] = px[i];
+					ref_y[i] = py[i];
+				}
+			});
+
+			built = true;
+			stats.builds++;
+			stats.pairs = neighbours.size();
+		}
+
+		// 64M entries, 256 MB of indices
+		static const size_t MAX_ENTRIES = size_t(1) << 26;
+
+		// Particles listed per task, and entries a task lists between updates of the shared total
+		static const size_t BUILD_ROWS = 1024;
+		static const size_t FLUSH_ENTRIES = 65536;
+
+		// Particles per task in the displacement check
+		static const size_t CHECK_GRAIN = 4096;
+
+		CellGrid grid;
+		float range_sqr;
+		float trigger_sqr;
+		bool built = false;
+
+		// Compressed rows: neighbours of i are neighbours[offsets[i] .. offsets[i + 1]]
+		std::vector<size_t> offsets;
+		std::vector<uint32_t> neighbours;
+
+		// Each range's own list during a build, and where it starts in neighbours
+		std::vector<std::vector<uint32_t>> range_lists;
+		std::vector<size_t> range_base;
+
+		// Positions at the last build
+		std::vector<float> ref_x;
+		std::vector<float> ref_y;
+
+		VerletListStats stats;
+};
+
+#endif
@@ -1,9 +1,15 @@
 #version 330 core
-layout (location = 0) in vec2 aPos;
+layout (location = 0) in ivec2 aPos; // position in [-1, 1] times QUANTIZE_SCALE
+layout (location = 1) in ivec2 aPrevPos; // same particle one tick earlier
+
+uniform float alpha; // how far the frame is from the previous tick to the current one
+
+const float QUANTIZE_SCALE = 32767.0; // must match quantize_kernel.h
 
 void main()
 {
-	gl_Position = vec4(aPos, 0.0, 1.0);
+	vec2 pos = mix(vec2(aPrevPos), vec2(aPos), alpha) / QUANTIZE_SCALE;
+	gl_Position = vec4(pos, 0.0, 1.0);
 	gl_PointSize = 5.0; // particle size
 }
 
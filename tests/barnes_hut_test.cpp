@@ -0,0 +1,86 @@
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include "barnes_hut.h"
+#include "scenarios.h"
+
+/*
+ * Barnes-Hut against the direct all-pairs sum at the default opening angle,
+ * on the uniform start, on the collapsed cluster, and on that cluster
+ * squeezed until far nodes reach within the minimum distance of the
+ * particles they act on. Fails when the worst particle's acceleration is
+ * further off than MAX_ERROR of the largest one.
+ */
+
+const float STRENGTH = 0.0001f;
+const float MIN_DIST_SQR = 0.0001f;
+const float THETA = 0.5f;
+const int COUNT = 4000;
+const uint64_t SEED = 1;
+const float SQUEEZE = 0.2f;
+const double MAX_ERROR = 0.03;
+
+// Same exclusion as the direct solver: pairs within the minimum distance are skipped
+static void direct_acceleration(const std::vector<Particle> &state, size_t i, double &ax, double &ay){
+	ax = 0.0;
+	ay = 0.0;
+	for (size_t j = 0; j < state.size(); j++){
+		double dx = double(state[j].x) - state[i].x;
+		double dy = double(state[j].y) - state[i].y;
+		double dist_sqr = dx * dx + dy * dy;
+		if (j == i || dist_sqr <= MIN_DIST_SQR){
+			continue;
+		}
+		double force = STRENGTH / (dist_sqr * std::sqrt(dist_sqr));
+		ax += dx * force;
+		ay += dy * force;
+	}
+}
+
+// Worst error over all particles, relative to the largest direct acceleration
+static double worst_error(const std::vector<Particle> &state){
+	ParticleStore particles(state.size());
+	for (size_t i = 0; i < state.size(); i++){
+		particles.set(i, state[i]);
+	}
+
+	BarnesHut tree(STRENGTH, MIN_DIST_SQR, THETA);
+	tree.build(particles);
+
+	double worst = 0.0;
+	double largest = 0.0;
+	for (size_t i = 0; i < state.size(); i++){
+		double ax, ay;
+		direct_acceleration(state, i, ax, ay);
+		float tree_ax, tree_ay;
+		tree.acceleration(i, particles, tree_ax, tree_ay);
+		worst = std::max(worst, std::hypot(tree_ax - ax, tree_ay - ay));
+		largest = std::max(largest, std::hypot(ax, ay));
+	}
+	return largest > 0.0 ? worst / largest : 0.0;
+}
+
+static bool check(const char *name, const std::vector<Particle> &state){
+	double error = worst_error(state);
+	bool ok = error < MAX_ERROR;
+	std::cout << name << ": worst error " << error * 100.0 << "% of the largest acceleration"
+		<< (ok ? "" : ", too far from direct") << "\n";
+	return ok;
+}
+
+int main(){
+	bool passed = check("uniform", generate_scenario(Scenario::Uniform, COUNT, SEED));
+
+	std::vector<Particle> cluster = generate_scenario(Scenario::Cluster, COUNT, SEED);
+	passed = check("cluster", cluster) && passed;
+
+	for (Particle &p : cluster){
+		p.x *= SQUEEZE;
+		p.y *= SQUEEZE;
+	}
+	passed = check("squeezed cluster", cluster) && passed;
+
+	return passed ? 0 : 1;
+}
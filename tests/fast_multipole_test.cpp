@@ -0,0 +1,103 @@
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include "fast_multipole.h"
+#include "scenarios.h"
+
+/*
+ * The fast multipole solver against the direct all-pairs sum, on the
+ * uniform start, on the collapsed cluster, and on that cluster squeezed
+ * until whole leaves sit within the minimum distance of each other. Fails
+ * when the worst particle's acceleration at the default order is further
+ * off than MAX_ERROR of the largest one, or when raising the order does not
+ * bring the error down.
+ */
+
+const float STRENGTH = 0.0001f;
+const float MIN_DIST_SQR = 0.0001f;
+const int COUNT = 4000;
+const uint64_t SEED = 1;
+const float SQUEEZE = 0.2f;
+const int DEFAULT_ORDER = 6;
+const int ORDERS[] = {4, 6, 8};
+const double MAX_ERROR = 0.001;
+
+// Same exclusion as the direct solver: pairs within the minimum distance are skipped
+static void direct_accelerations(const std::vector<Particle> &state, std::vector<double> &ax, std::vector<double> &ay){
+	ax.assign(state.size(), 0.0);
+	ay.assign(state.size(), 0.0);
+	for (size_t i = 0; i < state.size(); i++){
+		for (size_t j = 0; j < state.size(); j++){
+			double dx = double(state[j].x) - state[i].x;
+			double dy = double(state[j].y) - state[i].y;
+			double dist_sqr = dx * dx + dy * dy;
+			if (j == i || dist_sqr <= MIN_DIST_SQR){
+				continue;
+			}
+			double force = STRENGTH / (dist_sqr * std::sqrt(dist_sqr));
+			ax[i] += dx * force;
+			ay[i] += dy * force;
+		}
+	}
+}
+
+// Worst error over all particles at order, relative to the largest direct acceleration
+static double worst_error(const std::vector<Particle> &state, const std::vector<double> &ax,
+		const std::vector<double> &ay, int order){
+	ParticleStore particles(state.size());
+	for (size_t i = 0; i < state.size(); i++){
+		particles.set(i, state[i]);
+	}
+
+	FastMultipole multipole(STRENGTH, MIN_DIST_SQR, order);
+	std::vector<float> fmm_ax, fmm_ay;
+	multipole.accelerations(particles, fmm_ax, fmm_ay);
+
+	double worst = 0.0;
+	double largest = 0.0;
+	for (size_t i = 0; i < state.size(); i++){
+		worst = std::max(worst, std::hypot(fmm_ax[i] - ax[i], fmm_ay[i] - ay[i]));
+		largest = std::max(largest, std::hypot(ax[i], ay[i]));
+	}
+	return largest > 0.0 ? worst / largest : 0.0;
+}
+
+static bool check(const char *name, const std::vector<Particle> &state){
+	std::vector<double> ax, ay;
+	direct_accelerations(state, ax, ay);
+
+	bool ok = true;
+	double previous = 0.0;
+	for (int order : ORDERS){
+		double error = worst_error(state, ax, ay, order);
+		std::cout << name << ", order " << order << ": worst error " << error * 100.0 << "% of the largest acceleration";
+		if (order == DEFAULT_ORDER && error >= MAX_ERROR){
+			std::cout << ", too far from direct";
+			ok = false;
+		}
+		if (order != ORDERS[0] && error >= previous){
+			std::cout << ", no better than the order below";
+			ok = false;
+		}
+		std::cout << "\n";
+		previous = error;
+	}
+	return ok;
+}
+
+int main(){
+	bool passed = check("uniform", generate_scenario(Scenario::Uniform, COUNT, SEED));
+
+	std::vector<Particle> cluster = generate_scenario(Scenario::Cluster, COUNT, SEED);
+	passed = check("cluster", cluster) && passed;
+
+	for (Particle &p : cluster){
+		p.x *= SQUEEZE;
+		p.y *= SQUEEZE;
+	}
+	passed = check("squeezed cluster", cluster) && passed;
+
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,295 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cstring>
+#include <cmath>
+#include <cfloat>
+#include <limits>
+
+#include "integrate_kernel.h"
+#include "philox.h"
+#include "pair_kernel.h"
+#include "quantize_kernel.h"
+
+/*
+ * The vector kernels against their scalar versions. Kernels the CPU
+ * cannot run are skipped.
+ *
+ * The step kernels must match step_scalar bit for bit, over counts that
+ * leave partial vectors and partial blocks, on the SoA layout and on AoSoA
+ * blocks. Positions start on both sides of the walls so every bounce is
+ * taken. The noise kernels are held to noise_scalar the same way, with
+ * seeds and ticks that use all 64 bits, and the quantize kernels to
+ * quantize_scalar with values on and past the box edges.
+ *
+ * The pair rows sum in another order and fuse the squared distance, so
+ * they are only held to pair_row_scalar within PAIR_TOLERANCE. Rows of 1 to
+ * 33 particles cover every partial vector; some sit exactly on the
+ * distance limit, on the minimum distance, and on i itself. In half the
+ * rows i sits near the origin, so the zeros loaded past the end of the row
+ * fall inside the distance limit and must still be masked out.
+ */
+
+const int TICKS = 60;
+const uint32_t SEED = 1;
+
+const float PAIR_TOLERANCE = 1e-5f;
+
+// Entries past the end of each row or output, which a kernel must neither read nor write
+const size_t GUARD = 32;
+
+struct Layout{
+	size_t width;
+	size_t stride;
+};
+
+// Wall-to-wall particles laid out in blocks of width, one array per component
+struct State{
+	std::vector<float> x, y, vx, vy;
+
+	State(size_t count, const Layout &layout, std::mt19937 &gen){
+		const size_t blocks = (count + layout.width - 1) / layout.width;
+		x.assign(blocks * layout.stride, 0.0f);
+		y = vx = vy = x;
+		std::uniform_real_distribution<float> position(-1.1f, 1.1f);
+		std::uniform_real_distribution<float> velocity(-2.0f, 2.0f);
+		for (size_t i = 0; i < count; i++){
+			const size_t slot = i / layout.width * layout.stride + i % layout.width;
+			x[slot] = position(gen);
+			y[slot] = position(gen);
+			vx[slot] = velocity(gen);
+			vy[slot] = velocity(gen);
+		}
+	}
+
+	bool operator==(const State &other) const{
+		const size_t bytes = x.size() * sizeof(float);
+		return std::memcmp(x.data(), other.x.data(), bytes) == 0 && std::memcmp(y.data(), other.y.data(), bytes) == 0
+			&& std::memcmp(vx.data(), other.vx.data(), bytes) == 0 && std::memcmp(vy.data(), other.vy.data(), bytes) == 0;
+	}
+};
+
+// True when kernel leaves exactly what step_scalar does after every tick
+static bool matches(StepKernel kernel, size_t count, const Layout &layout){
+	std::mt19937 gen(SEED);
+	State expected(count, layout, gen);
+	State state = expected;
+
+	std::uniform_real_distribution<float> noise(-0.01f, 0.01f);
+	std::vector<float> noise_x(count), noise_y(count);
+	const StepParams params{1.0f / 60.0f, 0.1f, 0.05f, 0.0f, 0.001f};
+
+	for (int t = 0; t < TICKS; t++){
+		for (size_t i = 0; i < count; i++){
+			noise_x[i] = noise(gen);
+			noise_y[i] = noise(gen);
+		}
+		step_scalar(expected.x.data(), expected.y.data(), expected.vx.data(), expected.vy.data(),
+				noise_x.data(), noise_y.data(), count, layout.width, layout.stride, params);
+		kernel(state.x.data(), state.y.data(), state.vx.data(), state.vy.data(),
+				noise_x.data(), noise_y.data(), count, layout.width, layout.stride, params);
+		if (!(state == expected)){
+			return false;
+		}
+	}
+	return true;
+}
+
+// True when kernel draws exactly the samples noise_scalar does, for every seed, tick and range
+static bool noise_matches(NoiseKernel kernel, size_t count){
+	std::mt19937 gen(SEED);
+	std::vector<uint32_t> ids(count);
+	for (uint32_t &id : ids){
+		id = gen();
+	}
+
+	const uint64_t seeds[] = {0, 1, 0x9E3779B97F4A7C15ull, ~uint64_t(0)};
+	const uint64_t ticks[] = {0, 3, 0xFFFFFFFFull, 0x100000005ull, ~uint64_t(0)};
+	const float ranges[][2] = {{-0.01f, 0.01f}, {-1.0f, 3.0f}};
+
+	std::vector<float> expected_x(count), expected_y(count), x(count), y(count);
+	for (uint64_t seed : seeds){
+		for (uint64_t tick : ticks){
+			for (const auto &range : ranges){
+				const NoiseParams params{seed, tick, 7, range[0], range[1]};
+				noise_scalar(ids.data(), count, params, expected_x.data(), expected_y.data());
+				kernel(ids.data(), count, params, x.data(), y.data());
+				const size_t bytes = count * sizeof(float);
+				if (std::memcmp(x.data(), expected_x.data(), bytes) != 0 || std::memcmp(y.data(), expected_y.data(), bytes) != 0){
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+/*
+ * True when kernel adds what pair_row_scalar does to i and to every j of a
+ * row of count particles spread around i. Each term may be off by
+ * PAIR_TOLERANCE of its size, and i's sum by that much of its terms' sizes,
+ * on top of rounding the starting value.
+ */
+static bool pair_matches(PairRowKernel kernel, size_t count, float spread, const PairParams &params,
+		float centre_x, float centre_y){
+	std::mt19937 gen(SEED + uint32_t(count));
+	std::uniform_real_distribution<float> offset(-spread, spread);
+	std::uniform_real_distribution<float> start(-1.0f, 1.0f);
+
+	// i at 0 and the row at [1, count + 1), then guards holding NaN positions
+	const size_t size = count + 1 + GUARD;
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+	std::vector<float> x(size, nan), y(size, nan);
+	x[0] = centre_x;
+	y[0] = centre_y;
+	for (size_t k = 1; k <= count; k++){
+		switch (k % 5){
+			case 1:	// exactly sqrt(limit_sqr) away when that is 0.25
+				x[k] = x[0] + 0.25f;
+				y[k] = y[0];
+				break;
+			case 2:	// exactly sqrt(min_sqr) away when that is 2^-7
+				x[k] = x[0];
+				y[k] = y[0] + 0.0078125f;
+				break;
+			case 3:	// on top of i
+				x[k] = x[0];
+				y[k] = y[0];
+				break;
+			default:
+				x[k] = x[0] + offset(gen);
+				y[k] = y[0] + offset(gen);
+		}
+	}
+
+	std::vector<float> initial_x(size), initial_y(size);
+	for (size_t k = 0; k < size; k++){
+		initial_x[k] = start(gen);
+		initial_y[k] = start(gen);
+	}
+	std::vector<float> expected_x = initial_x, expected_y = initial_y;
+	std::vector<float> ax = initial_x, ay = initial_y;
+
+	const uint32_t end = uint32_t(count + 1);
+	pair_row_scalar(x.data(), y.data(), expected_x.data(), expected_y.data(), 0, 1, end, params);
+	kernel(x.data(), y.data(), ax.data(), ay.data(), 0, 1, end, params);
+
+	double terms_x = 0.0, terms_y = 0.0;
+	for (size_t k = 1; k <= count; k++){
+		terms_x += std::fabs(double(expected_x[k]) - initial_x[k]);
+		terms_y += std::fabs(double(expected_y[k]) - initial_y[k]);
+	}
+
+	auto close = [&](double got, double expected, double initial, double size){
+		double allowed = PAIR_TOLERANCE * size + 4.0 * FLT_EPSILON * std::fabs(initial);
+		return std::fabs(got - expected) <= allowed;
+	};
+	if (!close(ax[0], expected_x[0], initial_x[0], terms_x) || !close(ay[0], expected_y[0], initial_y[0], terms_y)){
+		return false;
+	}
+	for (size_t k = 1; k <= count; k++){
+		if (!close(ax[k], expected_x[k], initial_x[k], std::fabs(double(expected_x[k]) - initial_x[k]))
+				|| !close(ay[k], expected_y[k], initial_y[k], std::fabs(double(expected_y[k]) - initial_y[k]))){
+			return false;
+		}
+	}
+	for (size_t k = count + 1; k < size; k++){
+		if (ax[k] != initial_x[k] || ay[k] != initial_y[k]){
+			return false;
+		}
+	}
+	return true;
+}
+
+// True when kernel packs exactly what quantize_scalar does and nothing past the end
+static bool quantize_matches(QuantizeKernel kernel, size_t count){
+	std::mt19937 gen(SEED + uint32_t(count));
+	std::uniform_real_distribution<float> inside(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> outside(1.0f, 3.0f);
+	const float infinity = std::numeric_limits<float>::infinity();
+
+	// Box edges, values past them, infinities, and halfway points the rounding must break the same way
+	const float special[] = {-1.0f, 1.0f, -1.0f - FLT_EPSILON, 1.0f + FLT_EPSILON, -1e30f, 1e30f,
+		-infinity, infinity, 0.0f, -0.0f, 0.5f / QUANTIZE_SCALE, 1.5f / QUANTIZE_SCALE, -2.5f / QUANTIZE_SCALE};
+	const size_t specials = sizeof(special) / sizeof(special[0]);
+
+	std::vector<float> x(count), y(count);
+	for (size_t i = 0; i < count; i++){
+		const size_t pick = i + count;
+		x[i] = pick % 3 == 0 ? special[pick % specials] : pick % 3 == 1 ? inside(gen) : -outside(gen);
+		y[i] = pick % 4 == 0 ? special[(pick / 4) % specials] : pick % 4 == 1 ? outside(gen) : inside(gen);
+	}
+
+	std::vector<int16_t> expected(2 * count + GUARD, 0x5a5a), out = expected;
+	quantize_scalar(x.data(), y.data(), count, expected.data());
+	kernel(x.data(), y.data(), count, out.data());
+	return out == expected;
+}
+
+int main(){
+	const SimdLevel levels[] = {SimdLevel::Avx2, SimdLevel::Avx512};
+	const size_t counts[] = {1, 5, 16, 37, 1000, 4099};
+	const Layout layouts[] = {{16, 16}, {8, 32}, {16, 64}};
+	const size_t noise_counts[] = {1, 7, 8, 9, 15, 16, 17, 31, 4099};
+
+	// The direct sum, the short-range pass under a mesh, and limits a particle can sit exactly on
+	const PairParams pair_params[] = {
+		{-0.001f, 0.0001f, 0.05f, 0.0001f, 0.0f},
+		{-0.001f, 0.0f, 0.05f, 0.0001f, 0.0089443f},
+		{-0.001f, 0.0001f, 0.0625f, 0.00006103515625f, 0.01f}
+	};
+	const float spreads[] = {1.0f, 0.05f};
+
+	// Far from the origin, and close to it, where lanes past the end load zeros that land near i
+	const float centres[][2] = {{0.5f, -0.25f}, {0.125f, -0.0625f}};
+	const size_t longest_row = 33;
+
+	bool passed = true;
+	for (SimdLevel level : levels){
+		if (usable_simd_level(level) != level){
+			std::cout << simd_level_name(level) << ": not supported here, skipped\n";
+			continue;
+		}
+
+		bool ok = true;
+		for (size_t count : counts){
+			for (const Layout &layout : layouts){
+				if (!matches(select_step_kernel(level), count, layout)){
+					std::cout << simd_level_name(level) << ": differs from scalar at " << count
+						<< " particles, blocks of " << layout.width << " every " << layout.stride << " floats\n";
+					ok = false;
+				}
+			}
+		}
+		for (size_t count : noise_counts){
+			if (!noise_matches(select_noise_kernel(level), count)){
+				std::cout << simd_level_name(level) << ": noise differs from scalar at " << count << " particles\n";
+				ok = false;
+			}
+		}
+		for (size_t count = 1; count <= longest_row + 1; count++){
+			// Every row length up to longest_row, then one long row
+			const size_t row = count <= longest_row ? count : 1001;
+			for (const PairParams &params : pair_params){
+				for (float spread : spreads){
+					for (const auto &centre : centres){
+						if (!pair_matches(select_pair_kernel(level), row, spread, params, centre[0], centre[1])){
+							std::cout << simd_level_name(level) << ": pair row of " << row << " differs from scalar, spread "
+								<< spread << ", limit " << params.limit_sqr << ", i at (" << centre[0] << ", " << centre[1] << ")\n";
+							ok = false;
+						}
+					}
+				}
+			}
+			if (!quantize_matches(select_quantize_kernel(level), row)){
+				std::cout << simd_level_name(level) << ": quantize differs from scalar at " << row << " particles\n";
+				ok = false;
+			}
+		}
+		if (ok){
+			std::cout << simd_level_name(level) << ": matches scalar\n";
+		}
+		passed = passed && ok;
+	}
+	return passed ? 0 : 1;
+}